@@ -8,6 +8,7 @@
 
 struct Config {
     std::string world = "world.sqlite3";
+    std::string storage = "sqlite"; // or "region"
 
     struct {
         bool enabled = false;
@@ -34,5 +35,14 @@ struct Config {
         GLfloat aimSize = 15.0;
     } gui;
 
+    struct {
+        size_t size = 64; // MiB, 0 disables the cache
+        bool meshes = true;
+    } cache;
+
+    struct {
+        size_t radius = 1; // chunks copied around the player’s one, in steps
+    } clipboard;
+
     Config(LuaJIT *, const char *);
 };
\ No newline at end of file
@@ -6,6 +6,7 @@
 #include <gmpxx.h>
 
 #include <Math/Gyrovector.hxx>
+#include <Math/Hybrid.hxx>
 
 inline constexpr size_t Hword = sizeof(uint8_t);
 inline constexpr size_t Word  = sizeof(uint16_t);
@@ -16,12 +17,14 @@ using Real  = double;
 using Real² = std::pair<Real, Real>;
 using Real³ = std::tuple<Real, Real, Real>;
 
-using Integer = mpz_class;
+using Integer = Hybrid; // see `Math/Hybrid.hxx`
 using NodeId  = uint16_t;
 
 using Rank  = uint8_t;
 using Level = uint8_t;
 
+using Sections = uint16_t; // bitmask of chunk’s sections
+
 // Some helpful definitions
 template<typename T, int N> using Array² = std::array<std::array<T, N>, N>;
 
@@ -143,6 +146,14 @@ namespace Fundamentals {
     constexpr int chunkSize   = 16;
     constexpr int worldHeight = worldTop + 1;
 
+    // Chunk is split vertically into sections of `chunkSize × sectionHeight × chunkSize` nodes.
+    constexpr int sectionHeight = 16;
+    constexpr int sectionCount  = worldHeight / sectionHeight;
+
+    constexpr Sections allSections = Sections((1 << sectionCount) - 1);
+
+    static_assert(worldHeight % sectionHeight == 0 && sectionCount <= 8 * sizeof(Sections));
+
     // https://www.researchgate.net/publication/299161235_THE_HYPERBOLIC_SSQUARE_AND_MOBIUS_TRANSFORMATIONS
     // https://link.springer.com/book/10.1007/978-3-031-02396-5, “A Gyrovector Space Approach to Hyperbolic Geometry”
     // https://www.amazon.com/Analytic-Hyperbolic-Geometry-Einsteins-Relativity/dp/9811244103, “Analytic Hyperbolic Geometry and Albert Einstein’s Special Theory of Relativity”
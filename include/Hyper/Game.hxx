@@ -6,6 +6,7 @@
 #include <Hyper/Sheet.hxx>
 #include <Hyper/Physics.hxx>
 #include <Hyper/Geometry.hxx>
+#include <Hyper/Schematic.hxx>
 #include <Hyper/Fundamentals.hxx>
 
 enum class Action { Remove, Place };
@@ -43,6 +44,11 @@ namespace Game {
         extern int aimSize;
     }
 
+    namespace Clipboard {
+        extern Schematic schematic;
+        extern size_t radius; // in steps from the player’s chunk
+    }
+
     namespace Keyboard {
         extern bool forward;
         extern bool backward;
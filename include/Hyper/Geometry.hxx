@@ -1,5 +1,10 @@
 #pragma once
 
+#include <unordered_map>
+#include <memory>
+#include <atomic>
+#include <mutex>
+#include <list>
 #include <optional>
 #include <string>
 #include <vector>
@@ -8,9 +13,9 @@
 #include <chrono>
 
 #include <GL/glew.h>
-#include <sqlite3.h>
 
 #include <Hyper/Fundamentals.hxx>
+#include <Hyper/Storage.hxx>
 #include <Hyper/Shader.hxx>
 #include <Hyper/Sheet.hxx>
 
@@ -70,8 +75,49 @@ namespace Tesselation {
     extern const Real                     meter;
 }
 
+/*
+    Chunk’s position as a word over `Up`, `Down`, `Left` and `Right`: of all the shortest paths
+    from the spawn chunk we take the one that comes first in shortlex order (letters are ordered as in `Direction`).
+    Such words are exactly the ones accepted by a finite automaton (see `source/Geometry.cxx`),
+    so we keep the states it passes through, each of them being entered by only one letter.
+
+    Moving to a neighbour rewrites only the suffix where the two words differ, which takes amortized constant time,
+    while entries of `Fuchsian<Integer>` (and so the cost of every operation on them) grow with the distance.
+
+    Half-turn around chunk’s center ρ = ULDRUL belongs to the group generated by U, L, D & R,
+    so the same chunk may be entered in two orientations: `twist` tells which one, but only the word identifies the chunk.
+*/
+class Address {
+private:
+    std::vector<uint8_t> states; bool twist = false;
+
+    bool advance(size_t); // g(word) × x = g(new word) × ρ^(returned value)
+
+public:
+    Address() {}
+    explicit Address(const Fuchsian<Integer> &);
+
+    Fuchsian<Integer> isometry() const;
+
+    inline size_t length() const { return states.size(); }
+    Tesselation::Direction operator[](size_t) const;
+
+    Address operator*(Tesselation::Direction) const;
+    Address operator*(const Address &) const;
+
+    inline void normalize() {} // Address is always canonical, it’s here only for `Tesselation::eval`
+
+    // Compares chunks, not isometries (just like comparing `Fuchsian::origin`).
+    inline bool operator==(const Address & A) const { return states == A.states; }
+    inline bool flipped() const { return twist; }
+
+    friend struct AddressHash;
+};
+
+struct AddressHash { size_t operator()(const Address &) const; };
+
 template<typename T> struct Parallelogram {
-    Gyrovector<T> A, B, C, D;
+    T A, B, C, D;
 
     Parallelogram() {}
     Parallelogram(auto A, auto B, auto C, auto D) : A(A), B(B), C(C), D(D) {}
@@ -82,87 +128,201 @@ template<typename T> struct Parallelogram {
 struct Cube { Texture top, bottom, left, right, front, back; };
 struct NodeDef { std::string name; Cube cube; };
 
-struct Node { NodeId id; };
+// Index of a distinct texture, whose colors (lu, ru, rd, ld) are stored one after another in `NodeRegistry::colors`.
+using Material = uint16_t;
+struct Materials { Material top, bottom, left, right, front, back; };
 
+/*
+    Textures of the nodes are deduplicated into materials, so that a vertex of the mesh
+    refers to its color by a short index (see `FaceShaderSpec`) and the table of colors is uploaded only once.
+*/
 class NodeRegistry {
 private:
     NodeDef air; std::vector<NodeDef> table;
+    std::vector<Materials> _materials; std::vector<vec4> _colors;
+
+    Material material(Texture &);
 
 public:
+    constexpr static size_t materialLimit = 1 << 12;
+
     NodeRegistry();
 
-    inline NodeId attach(const NodeDef & def)
-    { table.push_back(def); return table.size() - 1; }
+    NodeId attach(const NodeDef &);
 
     inline NodeDef get(NodeId id) { return table[id]; }
+    inline const Materials & materials(NodeId id) const { return _materials[id]; }
+    inline const std::vector<vec4> & colors() const { return _colors; }
     inline bool has(NodeId id) { return id < table.size(); }
 };
 
-struct Blob {
-    Node data[Fundamentals::chunkSize][Fundamentals::worldHeight][Fundamentals::chunkSize];
+class Chunk; using ChunkOperator = Chunk *(Chunk *);
 
-    Blob() : data{} {}
-} __attribute__((packed));
+/*
+    Chunks with equal contents (e.g. made by the same generator) share one `Blob`,
+    which is never modified in place: chunk makes its own copy on the first write (see `Chunk::set`).
+*/
+class BlobPool {
+private:
+    std::mutex mutex; size_t swept = 0;
+    std::unordered_map<int64_t, std::weak_ptr<Blob>> table;
 
-class Chunk; using ChunkOperator = Chunk *(Chunk *);
+public:
+    // Returns either a shared blob equal to the given one or the given one, which becomes shared.
+    std::shared_ptr<Blob> intern(std::shared_ptr<Blob>);
+
+    size_t size(); // number of distinct shared blobs
+};
+
+/*
+    Recently unloaded chunks in encoded form (see `Encoding`), optionally together with their meshes,
+    so that walking back and forth across the render distance neither reloads nor remeshes them.
+    Least recently used entries are dropped once their total size exceeds `capacity` bytes.
+*/
+class ChunkCache {
+public:
+    struct Entry {
+        std::vector<uint8_t> data; bool meshed = false;
+
+        std::vector<FaceShader::Mesh> faces; // by section
+        std::vector<EdgeShader::Mesh> edges;
+
+        size_t size() const;
+    };
+
+private:
+    using Item = std::pair<std::string, Entry *>;
+
+    std::list<Item> order; // most recently used first
+    std::unordered_map<std::string, std::list<Item>::iterator> index;
+
+    size_t total = 0, _hits = 0, _misses = 0;
+
+public:
+    size_t capacity = 0; bool meshes = false;
+
+    ~ChunkCache();
+
+    void put(const Gaussian²<Integer> &, Entry *);
+    Entry * take(const Gaussian²<Integer> &); // returns nullptr if there is no such chunk, otherwise caller owns the entry
+    void clear();
+
+    inline size_t size()   const { return total;   } // bytes
+    inline size_t hits()   const { return _hits;   }
+    inline size_t misses() const { return _misses; }
+};
+
+/*
+    Chunk’s lifecycle: Loading → Ready → Meshing → Meshed → Ready → … → Unloading.
+    Workers only finish `Loading` and `Meshing`, all other transitions are made by the main thread.
+    Saving is allowed in every state but `Loading`, in particular together with meshing, since both only read the blob.
+*/
+enum class ChunkState : uint8_t { Loading, Ready, Meshing, Meshed, Unloading };
+
+constexpr size_t chunkStates = 5;
 
 class Chunk {
 private:
     Fuchsian<Integer> _isometry; Möbius<Real> _domain; Real _awayness; // used for drawing
+    size_t _drift = 0; static constexpr size_t reanchor = 32; // float steps composed into `_domain` since it was exact
     Gaussian²<Integer> _pos; // used for indexing, should be equal to `isometry.origin()`
 
-    bool _working = false; std::future<void> worker;
+    std::atomic<ChunkState> _state = ChunkState::Loading; std::future<void> worker;
     FaceShader::VAO faces; EdgeShader::VAO edges;
 
-    bool _ready = false, _dirty = false, _needRefresh = false, _needUnload = false, needUpdateVAO = false;
+    std::atomic<bool> _needRefresh = false;
+    // Modified sections (see `Fundamentals::sectionHeight`); the worker sets them while loading,
+    // so they may be touched from elsewhere only after `_state` has left `Loading`.
+    Sections _dirty = 0;
+
+    std::shared_ptr<Blob> _blob; bool _shared = false;
+    Summary _summary; // of `_blob`, kept up to date by `set` and `markDirty`
+
+    // Linked by `Atlas`: k-th neighbour is `isometry() * Tesselation::neighbours[k]`, nullptr if it’s not resident.
+    Tesselation::Array<Chunk *> _neighbours{}; Tesselation::Array<Gaussian²<Integer>> _around;
+
+    void unshare();
 
-    Blob * _blob = nullptr;
+    friend class Atlas;
 public:
 
     Chunk(const Fuchsian<Integer> & origin, const Fuchsian<Integer> & isometry);
 
     ~Chunk();
 
-    void emitFaces(NodeRegistry &);
-    void emitEdges(NodeRegistry &);
+    void emit(NodeRegistry &, Sections = Fundamentals::allSections); // faces and edges of the given sections
 
     void renderFaces(FaceShader *, unsigned int);
     void renderEdges(EdgeShader *, unsigned int);
 
     void updateMatrix(const Fuchsian<Integer> &);
+    void updateMatrix(const Fuchsian<Integer> &, const Möbius<Real> &);
     void refresh(NodeRegistry &);
+    void remesh(NodeRegistry &, Sections);
 
     bool walkable(Rank, Real, Rank);
 
-    void serialize(sqlite3_stmt *, int, int, int, int, int);
-    void load(ChunkOperator *, sqlite3 *);
-    void dump(sqlite3 *);
+    void load(ChunkOperator *, ChunkStore *, BlobPool *, ChunkCache::Entry * = nullptr);
+    void generate(ChunkOperator *);
+    void dump(ChunkStore *);
+    ChunkCache::Entry * stash(bool);
     void join();
 
-    inline bool working() const { return _working; }
+    inline ChunkState state() const { return _state; }
 
-    inline constexpr bool ready()       { return _ready;       }
-    inline constexpr bool dirty()       { return _dirty;       }
-    inline constexpr bool needRefresh() { return _needRefresh; }
-    inline constexpr bool needUnload()  { return _needUnload;  }
+    inline bool working() const { auto s = state(); return s == ChunkState::Loading || s == ChunkState::Meshing; }
+    inline bool ready()   const { auto s = state(); return s != ChunkState::Loading && s != ChunkState::Unloading; }
 
-    inline constexpr void unload()         { _needUnload = true;  }
-    inline constexpr auto requestRefresh() { _needRefresh = true; }
+    inline constexpr bool dirty() { return _dirty != 0; }
+
+    // Either blocks were changed or the fresh mesh awaits uploading.
+    inline bool needRefresh() const { return _needRefresh || state() == ChunkState::Meshed; }
+
+    // Chunk stops being drawn and will be removed by the atlas as soon as it’s saved.
+    void unload();
+    inline void requestRefresh() { _needRefresh = true; }
 
     inline constexpr auto awayness() const { return _awayness; }
 
+    inline Chunk * neighbour(size_t k) const { return _neighbours[k]; }
+    Chunk * neighbour(const Gaussian²<Integer> &) const;
+
+    inline const auto & neighbours() const { return _neighbours; }
+
     inline const auto isometry() const { return _isometry; }
     inline const auto domain()   const { return _domain;   }
     inline const auto pos()      const { return _pos;      }
 
-    inline Blob * blob() { if (_blob != nullptr) _dirty = true; return _blob; }
-    inline const Blob * blob() const { return _blob; }
+    inline constexpr auto dirtySections() const { return _dirty; }
+
+    // Whoever modifies the blob directly must call `markDirty` afterwards, it also rebuilds the summary and frees sections of air.
+    void markDirty(Sections = Fundamentals::allSections);
+
+    inline Blob * blob() { if (_shared) unshare(); return _blob.get(); }
+    inline const Blob * blob() const { return _blob.get(); }
+    inline bool shared() const { return _shared; }
+
+    inline const Summary & summary() const { return _summary; }
 
     inline auto get(Rank i, Level j, Rank k) const
-    { return _blob->data[i][j][k]; }
+    { return _blob->get(i, j, k); }
+
+    inline void set(size_t i, size_t j, size_t k, const Node & node) {
+        if (_shared) unshare();
+
+        auto s = j / Fundamentals::sectionHeight;
+        _dirty |= Sections(1) << s;
+
+        auto before = _blob->get(i, j, k).id;
+        _blob->set(i, j, k, node);
+        _summary.update(*_blob, i, j, k, before, node.id);
+
+        // Section that became all air is freed again, so that meshing and collisions skip it.
+        if (before != 0 && _summary.occupancy(s) == 0) _blob->clear(s);
+    }
 
-    inline void set(size_t i, size_t j, size_t k, const Node & node)
-    { _dirty = true; _blob->data[i][j][k] = node; }
+    // Sections whose meshes depend on the node at the given level (faces look at nodes above and below).
+    static Sections around(Level);
 
     static bool touch(const Gyrovector<Real> &, Rank, Rank);
     static std::pair<Rank, Rank> round(const Gyrovector<Real> &);
@@ -174,34 +334,45 @@ public:
     { return Math::remainder<Real>(x, Fundamentals::worldHeight); }
 };
 
+// Hash over canonical limbs of chunk’s position (see `Fuchsian::origin`).
+struct PositionHash { size_t operator()(const Gaussian²<Integer> &) const; };
+
 class Atlas {
 private:
-    sqlite3 * engine;
+    ChunkStore * store = nullptr; std::string world;
+    std::unordered_map<Gaussian²<Integer>, Chunk *, PositionHash> index; // same chunks as in `pool`
+    Fuchsian<Integer> anchor = Tesselation::I; // origin passed to the last `updateMatrix`
+
+    void link(Chunk *);
+    void unlink(Chunk *);
 
 public:
     std::vector<Chunk *> pool;
     ChunkOperator * generator = nullptr;
+    ChunkCache cache; BlobPool blobs;
 
     Atlas();
     ~Atlas();
 
-    void connect(std::string &);
+    void connect(const std::string & storage, const std::string & filename);
     void disconnect();
 
     void dump();
 
+    // Starts online backup, empty filename means timestamped file next to the world.
+    bool backup(const std::string & = "");
+
+    // Generates & saves chunks up to given number of steps away from the origin, returns (generated, visited).
+    std::pair<size_t, size_t> pregenerate(size_t radius);
+
     Chunk * poll(const Fuchsian<Integer> & origin, const Fuchsian<Integer> & isometry);
     Chunk * lookup(const Gaussian²<Integer> &);
 
-    void updateMatrix(const Fuchsian<Integer> &);
-};
+    std::vector<Chunk *>::iterator unload(std::vector<Chunk *>::iterator);
 
-template<typename T> struct Bitfield {
-    T value;
+    std::array<size_t, chunkStates> census() const; // number of chunks in each `ChunkState`
 
-    Bitfield(T value) : value(value) {}
-    inline operator T() { return value; }
+    void updateMatrix(const Fuchsian<Integer> &);
 
-    inline void set(size_t n, bool bit) { value = (value | (1 << n)) & ~(T(!bit) << n); }
-    inline bool get(size_t n) const { return (value >> n) & 1; }
+    inline const ChunkStore * persistence() const { return store; } // nullptr if the world isn’t saved
 };
@@ -0,0 +1,44 @@
+#pragma once
+
+#include <string>
+#include <vector>
+
+#include <Hyper/Geometry.hxx>
+
+/*
+    Copy of the chunks lying within given number of steps from the origin chunk, each one encoded (see `Encoding`).
+
+    Chunk is remembered by the canonical word of steps leading to it from the origin (see `Address`)
+    together with the quarter-turn between the frame of that word and chunk’s own frame
+    (isometry of the chunk is fixed only up to a rotation about its center, see `Chunk::Chunk`).
+
+    Quarter-turn of the whole schematic about the center of the origin permutes letters of the words
+    and turns every chunk by the same angle, so `rotate` only counts turns:
+    they are applied once to each chunk while pasting (see `Blob::rotate`).
+*/
+class Schematic {
+public:
+    struct Entry { std::vector<Tesselation::Direction> word; uint8_t turn; std::vector<uint8_t> data; };
+
+private:
+    std::vector<Entry> entries; uint8_t turns = 0;
+
+public:
+    static constexpr uint8_t version = 1;
+
+    // Copies ready chunks at most `radius` steps away from the given one, returns the number of copied chunks.
+    size_t copy(Atlas &, const Chunk *, size_t radius);
+
+    // Overwrites chunks around the given one (waiting for those not loaded yet), returns chunks that were changed.
+    std::vector<Chunk *> paste(Atlas &, const Fuchsian<Integer> & origin, const Chunk *) const;
+
+    inline void rotate(size_t quarters = 1) { turns = (turns + quarters) % 4; }
+
+    bool save(const std::string &) const;
+    bool load(const std::string &);
+
+    inline bool empty() const { return entries.empty(); }
+    inline size_t size() const { return entries.size(); }
+
+    size_t bytes() const; // size of encoded chunks
+};
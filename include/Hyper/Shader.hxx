@@ -1,8 +1,10 @@
 #pragma once
 
+#include <algorithm>
 #include <optional>
 #include <vector>
 #include <cstdio>
+#include <mutex>
 
 #include <GL/glew.h>
 
@@ -70,6 +72,9 @@ struct Attrib {
 
     constexpr static size_t size = GL::size(t) * n;
 
+    // Integer attributes reach the shader as they are (`uint` etc.) instead of being converted to floats.
+    constexpr static bool integral = std::is_integral_v<T>;
+
     static_assert(std::is_standard_layout_v<T>);
     static_assert(sizeof(T) == size);
 };
@@ -121,7 +126,11 @@ namespace GVA {
     template<size_t stride, EmptyList T> inline void attrib(size_t, size_t) {}
 
     template<size_t stride, NonEmptyList T> inline void attrib(size_t index, size_t pointer) {
-        glVertexAttribPointer(index, Head<T>::dim, Head<T>::type, GL_FALSE, stride, reinterpret_cast<void *>(pointer));
+        if constexpr(Head<T>::integral)
+            glVertexAttribIPointer(index, Head<T>::dim, Head<T>::type, stride, reinterpret_cast<void *>(pointer));
+        else
+            glVertexAttribPointer(index, Head<T>::dim, Head<T>::type, GL_FALSE, stride, reinterpret_cast<void *>(pointer));
+
         glEnableVertexAttribArray(index);
 
         attrib<stride, Tail<T>>(index + 1, pointer + Head<T>::size);
@@ -199,13 +208,55 @@ public:
 
     inline void activate() { glUseProgram(ref); }
 
-    struct VAO {
-        GLuint vao, vbo, ebo;
-        GLsizei count = 0;
+    // Vertices and indices (referring to these vertices) of some piece of geometry.
+    struct Mesh {
         VBO vertices;
         EBO indices;
 
+        inline Index index() const { return vertices.size(); }
+
+        inline void push() { indices.push_back(vertices.size()); }
+        inline void push(const Index index) { indices.push_back(index); }
+
+        template<typename... Ts> inline void emit(const Ts & ... ts)
+        { vertices.push_back(Tuple(ts...)); }
+
+        inline void clear() { vertices.clear(); indices.clear(); }
+
+        inline size_t bytes() const { return vertices.size() * stride + indices.size() * sizeof(Index); }
+    };
+
+    /*
+        Chunks are constantly created and destroyed while walking around, so freed VAOs are recycled:
+        their GL names (VAO already set up with its buffers) are reused by `initialize` and
+        their meshes (with allocated capacity) are reused by `clear`, up to `spareLimit` of each.
+    */
+    struct Names { GLuint vao, vbo, ebo; };
+
+    constexpr static size_t spareLimit = 64;
+
+    inline static std::vector<Names> spareNames; // only touched from GL thread
+    inline static std::vector<std::vector<Mesh>> spareStorage; inline static std::mutex spareMutex;
+
+    /*
+        VAO consists of parts (e.g. sections of a chunk), which are drawn at once. Buffers that are drawn dynamically
+        leave some room after each part, so that a changed part is replaced in place by `update` while it fits.
+        Unused indices of a slot repeat its first vertex, i.e. make degenerate primitives.
+    */
+    struct VAO {
+        struct Slot { size_t vertex = 0, vertices = 0, index = 0, indices = 0; }; // offsets and capacities
+
+        GLuint vao = 0, vbo = 0, ebo = 0;
+        GLsizei count = 0;
+        std::vector<Mesh> parts;
+        std::vector<Slot> slots; // as uploaded
+
         inline void initialize() {
+            if (!spareNames.empty()) {
+                auto names = spareNames.back(); spareNames.pop_back();
+                vao = names.vao; vbo = names.vbo; ebo = names.ebo; return;
+            }
+
             glGenVertexArrays(1, &vao);
             glGenBuffers(1, &vbo);
             glGenBuffers(1, &ebo);
@@ -216,18 +267,78 @@ public:
             attrib();
         }
 
+        inline Mesh & part(size_t k = 0) {
+            if (parts.size() <= k) parts.resize(k + 1);
+            return parts[k];
+        }
+
+        // Indices of the k-th part shifted to its slot and padded up to slot’s capacity.
+        inline void rebase(size_t k, Index * retval) const {
+            const auto & P = parts[k]; const auto & S = slots[k];
+
+            for (size_t n = 0; n < S.indices; n++)
+                retval[n] = S.vertex + (n < P.indices.size() ? P.indices[n] : 0);
+        }
+
         inline void upload(const GLenum usage) {
+            const bool room = usage != GL_STATIC_DRAW;
+            size_t vertices = 0, indices = 0;
+
+            slots.resize(parts.size());
+
+            for (size_t k = 0; k < parts.size(); k++) {
+                const auto & P = parts[k]; auto & S = slots[k];
+                S = {vertices, P.vertices.size(), indices, P.indices.size()};
+
+                // Number of indices in a slot is a multiple of 6, so that both lines and triangles stay aligned.
+                if (room && !P.indices.empty()) {
+                    S.vertices += S.vertices / 4 + 64;
+                    S.indices  = (S.indices + S.indices / 4 + 96 + 5) / 6 * 6;
+                }
+
+                vertices += S.vertices; indices += S.indices;
+            }
+
+            VBO vbuf(vertices); EBO ebuf(indices);
+
+            for (size_t k = 0; k < parts.size(); k++) {
+                std::copy(parts[k].vertices.begin(), parts[k].vertices.end(), vbuf.begin() + slots[k].vertex);
+                rebase(k, ebuf.data() + slots[k].index);
+            }
+
             glBindVertexArray(vao);
 
             glBindBuffer(GL_ARRAY_BUFFER, vbo);
-            glBufferData(GL_ARRAY_BUFFER, vertices.size() * stride, vertices.data(), usage);
+            glBufferData(GL_ARRAY_BUFFER, vbuf.size() * stride, vbuf.data(), usage);
 
             glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, ebo);
-            glBufferData(GL_ELEMENT_ARRAY_BUFFER, indices.size() * sizeof(Index), indices.data(), usage);
+            glBufferData(GL_ELEMENT_ARRAY_BUFFER, ebuf.size() * sizeof(Index), ebuf.data(), usage);
 
             glBindVertexArray(0);
 
-            count = indices.size();
+            count = indices;
+        }
+
+        // Uploads only the k-th part; returns false (uploading nothing) if it doesn’t fit into its slot anymore.
+        inline bool update(size_t k) {
+            if (k >= parts.size() || k >= slots.size()) return false;
+
+            const auto & P = parts[k]; const auto & S = slots[k];
+            if (P.vertices.size() > S.vertices || P.indices.size() > S.indices) return false;
+
+            EBO ebuf(S.indices); rebase(k, ebuf.data());
+
+            glBindVertexArray(vao);
+
+            glBindBuffer(GL_ARRAY_BUFFER, vbo);
+            glBufferSubData(GL_ARRAY_BUFFER, S.vertex * stride, P.vertices.size() * stride, P.vertices.data());
+
+            glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, ebo);
+            glBufferSubData(GL_ELEMENT_ARRAY_BUFFER, S.index * sizeof(Index), ebuf.size() * sizeof(Index), ebuf.data());
+
+            glBindVertexArray(0);
+
+            return true;
         }
 
         inline void bindVAO() {
@@ -242,23 +353,46 @@ public:
         inline void drawInstanced(const GLenum type, GLsizei ninstance)
         { bindVAO(); glDrawElementsInstanced(type, count, indexType, nullptr, ninstance); }
 
-        inline Index index() { return vertices.size(); }
-
-        inline void push() { indices.push_back(vertices.size()); }
-        inline void push(const Index index) { indices.push_back(index); }
+        inline void clear() {
+            if (parts.empty()) {
+                std::lock_guard<std::mutex> guard(spareMutex);
 
-        template<typename... Ts> inline void emit(const Ts & ... ts)
-        { vertices.push_back(Tuple(ts...)); }
+                if (!spareStorage.empty()) {
+                    parts = std::move(spareStorage.back());
+                    spareStorage.pop_back();
+                }
+            }
 
-        inline void clear() {
-            vertices.clear();
-            indices.clear();
+            for (auto & P : parts) P.clear();
         }
 
+        inline bool initialized() const { return vao != 0; }
+
         inline void free() {
-            glDeleteBuffers(1, &vbo);
-            glDeleteBuffers(1, &ebo);
-            glDeleteVertexArrays(1, &vao);
+            if (!parts.empty()) {
+                std::lock_guard<std::mutex> guard(spareMutex);
+
+                if (spareStorage.size() < spareLimit) {
+                    for (auto & P : parts) P.clear();
+                    spareStorage.push_back(std::move(parts));
+                }
+
+                parts.clear();
+            }
+
+            slots.clear();
+
+            if (!initialized()) return;
+
+            if (spareNames.size() < spareLimit)
+                spareNames.push_back({vao, vbo, ebo});
+            else {
+                glDeleteBuffers(1, &vbo);
+                glDeleteBuffers(1, &ebo);
+                glDeleteVertexArrays(1, &vao);
+            }
+
+            vao = vbo = ebo = 0; count = 0;
         }
     };
 };
@@ -335,12 +469,55 @@ public:
     }
 };
 
+/*
+    Read-only table sampled in shaders as `samplerBuffer` (with `texelFetch`),
+    bound once to its own texture unit, which is the value of the sampler uniform.
+*/
+template<typename T> class TBO {
+private:
+    GLenum format; GLint unit;
+    GLuint buffer = 0, texture = 0; size_t _size = 0;
+
+public:
+    TBO(GLenum format, GLint unit) : format(format), unit(unit) {}
+
+    void initialize() {
+        glGenBuffers(1, &buffer);
+        glGenTextures(1, &texture);
+    }
+
+    void upload(const std::vector<T> & data) {
+        glBindBuffer(GL_TEXTURE_BUFFER, buffer);
+        glBufferData(GL_TEXTURE_BUFFER, data.size() * sizeof(T), data.data(), GL_STATIC_DRAW);
+        glBindBuffer(GL_TEXTURE_BUFFER, 0);
+
+        glActiveTexture(GL_TEXTURE0 + unit);
+        glBindTexture(GL_TEXTURE_BUFFER, texture);
+        glTexBuffer(GL_TEXTURE_BUFFER, format, buffer);
+        glActiveTexture(GL_TEXTURE0);
+
+        _size = data.size();
+    }
+
+    inline GLint index() const { return unit; }
+    inline size_t size() const { return _size; }
+
+    void free() {
+        glDeleteTextures(1, &texture);
+        glDeleteBuffers(1, &buffer);
+    }
+};
+
+/*
+    Vertex of a chunk is packed into 32 bits (see `model` in `shaders/Voxel/Common.glsl`):
+    the index of the corner in `Tesselation::corners` and the level, 9 bits each,
+    then (only for faces) 14 bits for the index of the color in the table of materials (see `NodeRegistry`).
+*/
 struct FaceShaderSpec {
     using Index = GLuint;
 
     using Params =
-    List<Attrib<"_color",  vec4, GL_FLOAT, 4>,
-         Attrib<"_vertex", vec3, GL_FLOAT, 3>>;
+    List<Attrib<"_vertex", GLuint, GL_UNSIGNED_INT, 1>>;
 };
 
 using FaceShader = ShaderProgram<FaceShaderSpec>;
@@ -349,7 +526,7 @@ struct EdgeShaderSpec {
     using Index = GLuint;
 
     using Params =
-    List<Attrib<"_vertex", vec3, GL_FLOAT, 3>>;
+    List<Attrib<"_vertex", GLuint, GL_UNSIGNED_INT, 1>>;
 };
 
 using EdgeShader = ShaderProgram<EdgeShaderSpec>;
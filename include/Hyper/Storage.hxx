@@ -0,0 +1,344 @@
+#pragma once
+
+#include <condition_variable>
+#include <unordered_map>
+#include <shared_mutex>
+#include <string>
+#include <vector>
+#include <thread>
+#include <atomic>
+#include <mutex>
+
+#include <sqlite3.h>
+
+#include <Hyper/Fundamentals.hxx>
+#include <Math/Gaussian.hxx>
+
+struct Node { NodeId id; };
+
+/*
+    Horizontal slab of the chunk (see `Fundamentals::sectionHeight`), its n-th node is at [i][j mod sectionHeight][k]
+    of the chunk, where n = (i × sectionHeight + j mod sectionHeight) × chunkSize + k.
+
+    Nodes are kept as indices into the palette of `NodeId`s, packed into 64-bit words `bits` bits each,
+    `bits` is the least of 0, 1, 2, 4, 8 enough for the palette; with more than 256 kinds of nodes
+    the palette is dropped and `NodeId`s themselves are stored (16 bits each).
+    Palette only grows, entries no longer used are dropped when it overflows.
+*/
+class Section {
+public:
+    static constexpr size_t volume = Fundamentals::chunkSize * Fundamentals::sectionHeight * Fundamentals::chunkSize;
+
+private:
+    std::vector<NodeId> palette{0}; std::vector<uint64_t> words; uint8_t bits = 0;
+
+    inline size_t index(size_t n) const
+    { return bits == 0 ? 0 : (words[n * bits / 64] >> (n * bits % 64)) & ((uint64_t(1) << bits) - 1); }
+
+    inline void put(size_t n, size_t idx) {
+        auto & word = words[n * bits / 64]; auto shift = n * bits % 64;
+        word = (word & ~(((uint64_t(1) << bits) - 1) << shift)) | (uint64_t(idx) << shift);
+    }
+
+    size_t lookup(NodeId); // index of the given node, it’s added to the palette if necessary
+    void assign(const std::vector<NodeId> &, size_t spare);
+
+public:
+    static inline size_t at(size_t i, size_t j, size_t k)
+    { return (i * Fundamentals::sectionHeight + j % Fundamentals::sectionHeight) * Fundamentals::chunkSize + k; }
+
+    inline NodeId get(size_t n) const
+    { auto idx = index(n); return palette.empty() ? NodeId(idx) : palette[idx]; }
+
+    inline void set(size_t n, NodeId id)
+    { auto idx = lookup(id); if (bits > 0) put(n, idx); }
+
+    void fill(size_t n, size_t m, NodeId); // sets nodes n, n + 1, ..., m - 1
+    void unpack(NodeId *) const;           // writes all `volume` nodes in the order of `at`
+    void rotate(size_t quarters);           // see `Blob::rotate`
+
+    bool operator==(const Section &) const;
+    int64_t digest() const;
+};
+
+/*
+    Nodes of the chunk, indexed as [i][j][k] where j is the height.
+    Sections are allocated on the first write of non-air node, null section consists entirely of air,
+    so empty sky takes no memory and is skipped by meshing.
+*/
+class Blob {
+private:
+    Section * sections[Fundamentals::sectionCount] = {};
+
+public:
+    Blob() {}
+    Blob(const Blob &);
+    Blob(Blob &&);
+    ~Blob();
+
+    Blob & operator=(const Blob &);
+    Blob & operator=(Blob &&);
+
+    bool operator==(const Blob &) const;
+
+    inline bool empty(size_t s) const { return sections[s] == nullptr; }
+    inline const Section * section(size_t s) const { return sections[s]; }
+
+    Section * allocate(size_t s); // returns section `s`, allocating it if needed
+
+    void clear(size_t s);
+    void clear();
+
+    // Turns every level clockwise about the vertical axis: one quarter-turn moves node at (i, k) to (chunkSize − 1 − k, i).
+    void rotate(size_t quarters);
+
+    int64_t digest() const; // hash of nodes, equal blobs have equal digests
+
+    inline Node get(size_t i, size_t j, size_t k) const {
+        auto section = sections[j / Fundamentals::sectionHeight];
+        return section == nullptr ? Node() : Node{section->get(Section::at(i, j, k))};
+    }
+
+    inline void set(size_t i, size_t j, size_t k, const Node & node) {
+        auto & section = sections[j / Fundamentals::sectionHeight];
+
+        if (section == nullptr) { if (node.id == 0) return; section = new Section(); }
+        section->set(Section::at(i, j, k), node.id);
+    }
+};
+
+/*
+    Height map of the blob: the lowest and the highest non-air level of each column
+    together with the number of non-air nodes in each section.
+    Column of air has `bottom = worldTop` and `top = 0`, i.e. its range is empty (see `empty`).
+*/
+class Summary {
+private:
+    Array²<Level, Fundamentals::chunkSize> _bottom, _top;
+    std::array<uint16_t, Fundamentals::sectionCount> _occupancy;
+
+    void rescan(const Blob &, size_t i, size_t k);
+
+public:
+    inline Summary() { clear(); }
+
+    void clear();
+    void build(const Blob &);
+
+    // Should be called after every change of the node at (i, j, k), given its previous and current ids.
+    void update(const Blob &, size_t i, size_t j, size_t k, NodeId before, NodeId after);
+
+    inline Level bottom(size_t i, size_t k) const { return _bottom[i][k]; }
+    inline Level top(size_t i, size_t k)    const { return _top[i][k];    }
+
+    inline bool empty(size_t i, size_t k) const { return _top[i][k] < _bottom[i][k]; }
+    inline size_t occupancy(size_t s) const { return _occupancy[s]; }
+
+    // Whether levels j₁ ≤ j ≤ j₂ of the column are known to be air without reading it.
+    inline bool clear(size_t i, int j₁, int j₂, size_t k) const
+    { return j₁ <= j₂ && 0 <= j₁ && j₂ <= Fundamentals::worldTop && (j₂ < _bottom[i][k] || _top[i][k] < j₁); }
+};
+
+/*
+    On-disk chunk format. Legacy rows hold raw nodes (exactly `sizeof(NodeId)` bytes per node),
+    newer ones start with a version byte followed by a palette of `NodeId`s
+    and run-length coded palette indices (see `source/Storage.cxx`).
+*/
+namespace Encoding {
+    constexpr uint8_t version = 1;
+
+    std::vector<uint8_t> encode(const Blob &);
+    std::vector<uint8_t> encode(const Blob &, size_t section);
+
+    bool decode(Blob &, const void *, size_t);
+    bool decode(Blob &, size_t section, const void *, size_t);
+
+    std::string key(const Gaussian²<Integer> &);
+
+    int64_t hash(const void *, size_t);
+    int64_t hash(const std::string &);
+}
+
+/*
+    Persistent storage of chunks behind `Atlas`.
+
+    Loads are called concurrently from chunk workers. Saves are staged by `push`,
+    handed over by `submit` and written by the background thread, one batch per `flush`; batch that fails is retried.
+    Between flushes the same thread does long background work (backups) in small steps, see `step`.
+    Chunks are stored section by section (see `Fundamentals::sectionHeight`), so only modified sections are written.
+*/
+class ChunkStore {
+public:
+    struct Job { Gaussian²<Integer> pos; Blob * blob; Sections sections; };
+
+    // Result of `maintain`; `dropped` counts chunks removed as a whole, `cleared` counts removed sections of air.
+    struct Report { size_t chunks = 0, sections = 0, corrupt = 0, reencoded = 0, dropped = 0, cleared = 0, before = 0, after = 0; };
+
+private:
+    std::thread thread; std::mutex mutex; std::condition_variable cv;
+    std::vector<Job> staged, queue, flushing; bool running = false, stepping = false;
+
+    std::atomic<size_t> _depth = 0, _flushes = 0;
+    std::atomic<double> _latency = 0; // seconds
+
+    void loop();
+
+protected:
+    void start();
+    void stop(); // must be called by the derived class before it closes anything used by `flush`
+
+    // Returns true iff the whole batch was stored; otherwise nothing was stored and the batch is retried later.
+    virtual bool flush(std::vector<Job> &) = 0;
+    virtual bool read(const Gaussian²<Integer> &, Blob &, Sections &) = 0; // see `load`
+
+    // Makes the writer thread call `step` between flushes until it returns false; returns false if it’s already doing so.
+    bool resume();
+    virtual bool step() { return false; }
+
+public:
+    virtual ~ChunkStore() {}
+
+    /*
+        Returns false iff there is no such chunk in the storage.
+        Sections that should be written again (e.g. because they are stored in an outdated format) are added to the last argument.
+        Chunk that is still waiting to be written is taken from the latest pending copy, so loads always see earlier saves.
+    */
+    bool load(const Gaussian²<Integer> &, Blob &, Sections &);
+
+    void push(const Gaussian²<Integer> &, const Blob &, Sections); // stages a copy of the chunk, only given sections will be written
+
+    /*
+        Offline maintenance: checks that everything decodes, re-encodes sections stored in older formats,
+        drops chunks that are all air (they will be generated again) and compacts the storage.
+        Sections that fail to decode are kept as is. Must not be called while chunks are loaded or saved.
+    */
+    virtual Report maintain() = 0;
+
+    /*
+        Starts copying the storage into the given file, which appears there only when the copy is complete.
+        The copy is consistent and doesn’t stop saves. Returns false if another backup is still running.
+    */
+    virtual bool backup(const std::string &) = 0;
+    bool busy(); // whether backup is running
+    void submit(); // hands everything staged to the writer thread
+
+    inline size_t depth()   const { return _depth;   } // chunks waiting to be written
+    inline size_t flushes() const { return _flushes; }
+    inline double latency() const { return _latency; } // duration of the last flush
+
+    // `kind` is either "sqlite" or "region"
+    static ChunkStore * open(const std::string & kind, const std::string & filename);
+};
+
+// Pool of read-only connections with prepared `loadcmd`, so that loads never wait for each other or for the writer.
+class Readers {
+public:
+    struct Connection { sqlite3 * engine; sqlite3_stmt * statement; };
+
+private:
+    std::vector<Connection> all, idle;
+    std::mutex mutex; std::condition_variable cv;
+
+public:
+    void open(const std::string &, size_t);
+    void close();
+
+    Connection acquire();
+    void release(const Connection &);
+};
+
+class SQLiteStore : public ChunkStore {
+private:
+    sqlite3 * engine = nullptr; Readers readers;
+    sqlite3_stmt * insert = nullptr, * share = nullptr, * check = nullptr;
+    sqlite3_stmt * begin = nullptr, * commit = nullptr, * rollback = nullptr;
+
+    std::string target; sqlite3 * copy = nullptr; sqlite3_backup * progress = nullptr;
+    void finish(bool);
+
+    void prepare(std::initializer_list<std::pair<const char *, sqlite3_stmt **>>);
+    bool write(int64_t, const std::string &, size_t, const std::vector<uint8_t> &);
+
+    void migrate();
+    template<typename F> void migrate(const char *, const char *, F &&);
+
+protected:
+    bool flush(std::vector<Job> &) override;
+    bool read(const Gaussian²<Integer> &, Blob &, Sections &) override;
+    bool step() override;
+
+public:
+    SQLiteStore(const std::string &);
+    ~SQLiteStore();
+
+    Report maintain() override;
+    bool backup(const std::string &) override;
+
+    static void serialize(sqlite3_stmt *, const Gaussian²<Integer> &, int, int);
+};
+
+/*
+    Append-only region file, mapped into memory.
+
+    Encoded sections are appended one after another, the file also contains an open-addressing hash table
+    from `Encoding::hash` of section’s key to the latest record; when it gets half full, bigger table is appended.
+    Key of the section is the key of its chunk followed by one byte with the number of the section.
+    Records with the key of the whole chunk are left from older files.
+
+    Record may instead refer to the data of an earlier record with the same contents (see `Record::shared`).
+    Writer finds such records only among those written since the file was opened, `maintain` deduplicates everything.
+    Chunks are decoded straight from the mapping. Integers are stored in host byte order.
+*/
+class RegionStore : public ChunkStore {
+private:
+    struct Header { char magic[8]; uint64_t indexOffset, capacity, count, end; };
+    struct Slot   { int64_t hash; uint64_t offset; }; // offset = 0 means empty slot
+    // Followed by the key and the data or, if `dataSize & shared`, by u64 offset of the record that holds the data.
+    struct Record { uint32_t keySize, dataSize; static constexpr uint32_t shared = 1U << 31; };
+    struct Entry  { std::string key; int64_t hash; std::vector<uint8_t> data; uint64_t offset; };
+
+    std::string filename; int fd = -1; uint8_t * map = nullptr; size_t mapped = 0;
+    std::unordered_map<int64_t, uint64_t> payloads; // digest of the data → its record, used only by the writer
+
+    // Backup copies data written before it started, then header and index as they were at that moment.
+    std::string target; int copy = -1; uint64_t copied = 0; Header snapshot; std::vector<Slot> index;
+    void finish(bool);
+    std::shared_mutex lock; // exclusive for remapping and index updates
+
+    inline Header * header() const { return reinterpret_cast<Header *>(map); }
+    inline Slot * slots() const { return reinterpret_cast<Slot *>(map + header()->indexOffset); }
+
+    void reserve(size_t);
+    void remap(size_t);
+    void sync(size_t, size_t);
+
+    Slot * find(int64_t, const std::string &) const;
+    void insert(int64_t, uint64_t);
+    void grow(uint64_t);
+
+    const uint8_t * data(uint64_t, uint32_t &) const;
+    const uint8_t * lookup(const std::string &, uint32_t &) const;
+    bool append(std::vector<Entry> &);
+
+protected:
+    bool flush(std::vector<Job> &) override;
+    bool read(const Gaussian²<Integer> &, Blob &, Sections &) override;
+    bool step() override;
+
+public:
+    RegionStore(const std::string &);
+    ~RegionStore();
+
+    Report maintain() override;
+    bool backup(const std::string &) override;
+};
+
+template<typename T> struct Bitfield {
+    T value;
+
+    Bitfield(T value) : value(value) {}
+    inline operator T() { return value; }
+
+    inline void set(size_t n, bool bit) { value = (value | (1 << n)) & ~(T(!bit) << n); }
+    inline bool get(size_t n) const { return (value >> n) & 1; }
+};
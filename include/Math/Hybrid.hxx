@@ -0,0 +1,153 @@
+#pragma once
+
+#include <compare>
+#include <utility>
+#include <cstdlib>
+
+#include <Math/Euclidean.hxx>
+
+/*
+    Integer kept in `int64_t` while it fits and promoted to `mpz_class` otherwise,
+    intermediate results are computed in `__int128`, so arithmetic on small values never touches the heap.
+
+    Representation is canonical: value is stored in `mpz_class` iff |value| ≥ 2⁶³,
+    so equal values always look the same (see `Encoding::key` and `PositionHash`).
+*/
+class Hybrid {
+private:
+    int64_t n = 0; mpz_class * z = nullptr;
+
+    static inline mpz_class widen(__int128 x) {
+        unsigned __int128 m = x < 0 ? -static_cast<unsigned __int128>(x) : x;
+        uint64_t words[2] = {uint64_t(m), uint64_t(m >> 64)};
+
+        mpz_class retval; mpz_import(retval.get_mpz_t(), 2, -1, sizeof(uint64_t), 0, 0, words);
+        if (x < 0) mpz_neg(retval.get_mpz_t(), retval.get_mpz_t());
+
+        return retval;
+    }
+
+    inline void assign(__int128 x) {
+        if (-__int128(INT64_MAX) <= x && x <= INT64_MAX) { delete z; z = nullptr; n = int64_t(x); }
+        else assign(widen(x));
+    }
+
+    inline void assign(mpz_class && x) {
+        if (mpz_sizeinbase(x.get_mpz_t(), 2) <= 63) {
+            uint64_t m = 0; mpz_export(&m, nullptr, -1, sizeof(uint64_t), 0, 0, x.get_mpz_t());
+            delete z; z = nullptr; n = mpz_sgn(x.get_mpz_t()) < 0 ? -int64_t(m) : int64_t(m);
+        } else if (z != nullptr) *z = std::move(x);
+        else z = new mpz_class(std::move(x));
+    }
+
+public:
+    inline Hybrid() {}
+    template<std::integral I> inline Hybrid(I x) { assign(__int128(x)); }
+    inline Hybrid(__int128 x) { assign(x); }
+    inline explicit Hybrid(mpz_class x) { assign(std::move(x)); }
+
+    inline Hybrid(const Hybrid & x) : n(x.n), z(x.z == nullptr ? nullptr : new mpz_class(*x.z)) {}
+    inline Hybrid(Hybrid && x) : n(x.n), z(x.z) { x.z = nullptr; }
+
+    inline ~Hybrid() { delete z; }
+
+    inline Hybrid & operator=(const Hybrid & x) {
+        if (x.z == nullptr) { delete z; z = nullptr; n = x.n; }
+        else if (z != nullptr) *z = *x.z;
+        else z = new mpz_class(*x.z);
+
+        return *this;
+    }
+
+    inline Hybrid & operator=(Hybrid && x) { std::swap(n, x.n); std::swap(z, x.z); return *this; }
+
+    inline bool fits() const { return z == nullptr; }
+    inline int64_t word() const { return n; }         // valid only if `fits()`
+    inline const mpz_class & mpz() const { return *z; } // valid only if not `fits()`
+
+    inline mpz_class wide() const { return z == nullptr ? widen(n) : *z; }
+
+    inline int sign() const { return z == nullptr ? (n > 0) - (n < 0) : mpz_sgn(z->get_mpz_t()); }
+
+    inline Hybrid operator-() const { return z == nullptr ? Hybrid(-n) : Hybrid(mpz_class(-*z)); }
+    inline const Hybrid & operator+() const { return *this; }
+
+    friend inline Hybrid operator+(const Hybrid & a, const Hybrid & b)
+    { return a.fits() && b.fits() ? Hybrid(__int128(a.n) + b.n) : Hybrid(mpz_class(a.wide() + b.wide())); }
+
+    friend inline Hybrid operator-(const Hybrid & a, const Hybrid & b)
+    { return a.fits() && b.fits() ? Hybrid(__int128(a.n) - b.n) : Hybrid(mpz_class(a.wide() - b.wide())); }
+
+    friend inline Hybrid operator*(const Hybrid & a, const Hybrid & b)
+    { return a.fits() && b.fits() ? Hybrid(__int128(a.n) * b.n) : Hybrid(mpz_class(a.wide() * b.wide())); }
+
+    // Truncates just like both `int64_t` and `mpz_class`.
+    friend inline Hybrid operator/(const Hybrid & a, const Hybrid & b)
+    { return a.fits() && b.fits() ? Hybrid(a.n / b.n) : Hybrid(mpz_class(a.wide() / b.wide())); }
+
+    inline void operator+=(const Hybrid & x) { *this = *this + x; }
+    inline void operator-=(const Hybrid & x) { *this = *this - x; }
+    inline void operator*=(const Hybrid & x) { *this = *this * x; }
+    inline void operator/=(const Hybrid & x) { *this = *this / x; }
+
+    friend inline bool operator==(const Hybrid & a, const Hybrid & b) {
+        if (a.fits() || b.fits()) return a.fits() && b.fits() && a.n == b.n;
+        return mpz_cmp(a.z->get_mpz_t(), b.z->get_mpz_t()) == 0;
+    }
+
+    friend inline std::strong_ordering operator<=>(const Hybrid & a, const Hybrid & b) {
+        if (a.fits() && b.fits()) return a.n <=> b.n;
+
+        // Promoted values are greater by absolute value than any unpromoted one.
+        if (a.fits()) return 0 <=> b.sign();
+        if (b.fits()) return a.sign() <=> 0;
+
+        return mpz_cmp(a.z->get_mpz_t(), b.z->get_mpz_t()) <=> 0;
+    }
+
+    friend inline std::ostream & operator<<(std::ostream & stream, const Hybrid & x)
+    { return x.fits() ? stream << x.n : stream << *x.z; }
+};
+
+namespace Math {
+    template<> inline Hybrid zero<Hybrid> = Hybrid(0);
+    template<> inline Hybrid one<Hybrid> = Hybrid(1);
+
+    template<> inline void divexact<Hybrid>(Hybrid & q, const Hybrid & n, const Hybrid & d) {
+        if (n.fits() && d.fits()) { q = Hybrid(n.word() / d.word()); return; }
+
+        mpz_class retval; auto N = n.wide(), D = d.wide();
+        mpz_divexact(retval.get_mpz_t(), N.get_mpz_t(), D.get_mpz_t()); q = Hybrid(std::move(retval));
+    };
+
+    template<> inline void twice<Hybrid>(Hybrid & n) {
+        if (n.fits()) { n = Hybrid(__int128(n.word()) * 2); return; }
+
+        auto retval = n.mpz(); mpz_mul_2exp(retval.get_mpz_t(), retval.get_mpz_t(), 1); n = Hybrid(std::move(retval));
+    }
+
+    template<> inline void half<Hybrid>(Hybrid & n) {
+        if (n.fits()) { n = Hybrid(n.word() >> 1); return; }
+
+        auto retval = n.mpz(); mpz_fdiv_q_2exp(retval.get_mpz_t(), retval.get_mpz_t(), 1); n = Hybrid(std::move(retval));
+    }
+
+    template<> inline bool odd<Hybrid>(const Hybrid & n)
+    { return n.fits() ? bool(n.word() & 1) : bool(mpz_odd_p(n.mpz().get_mpz_t())); }
+
+    template<> inline bool isZero<Hybrid>(const Hybrid & n) { return n.fits() && n.word() == 0; }
+    template<> inline bool isUnit<Hybrid>(const Hybrid & n) { return n.fits() && std::abs(n.word()) == 1; }
+
+    template<> inline bool isNeg<Hybrid>(const Hybrid & n) { return n.sign() < 0; }
+
+    template<> inline bool equal<Hybrid>(const Hybrid & n, const Hybrid & m) { return n == m; }
+
+    template<> inline float field<Hybrid, float>(const Hybrid & n)
+    { return n.fits() ? float(n.word()) : float(mpz_get_d(n.mpz().get_mpz_t())); }
+
+    template<> inline double field<Hybrid, double>(const Hybrid & n)
+    { return n.fits() ? double(n.word()) : mpz_get_d(n.mpz().get_mpz_t()); }
+
+    template<> inline void * serialize<Hybrid>(const Hybrid & n, size_t & k)
+    { auto N = n.wide(); return mpz_export(nullptr, &k, 1, 1, 0, 0, N.get_mpz_t()); }
+}
@@ -26,6 +26,12 @@ uniform Moebius origin;
 
 uniform float hrd, vrd, worldHeight;
 
+// Points of the grid, indexed as `Tesselation::corners` (see `FaceShaderSpec` for the layout of a vertex).
+uniform samplerBuffer corners;
+
+vec3 unpack(uint v)
+{ return vec3(texelFetch(corners, int(v & 511u)).xy, float((v >> 9) & 511u)); }
+
 vec4 model(vec3 v, int iid) {
     vec2 w = applyModel(apply(origin, apply(domain, v.xy)));
     return vec4(w.x, v.z + (iid - vrd) * worldHeight, w.y, 1.0);
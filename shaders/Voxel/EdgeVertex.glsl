@@ -1,8 +1,8 @@
-in  vec3  _vertex;
+in  uint  _vertex;
 out float fogFactor;
 
 void main() {
-    vec4 vertex = view * model(_vertex, gl_InstanceID);
+    vec4 vertex = view * model(unpack(_vertex), gl_InstanceID);
 
     gl_Position = projection * vertex;
     fogFactor   = getFogFactor(length(vertex));
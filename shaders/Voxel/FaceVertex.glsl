@@ -1,12 +1,14 @@
-in  vec4  _color;
-in  vec3  _vertex;
+in  uint  _vertex;
 out vec4  color;
 out float fogFactor;
 
+// Four colors (lu, ru, rd, ld) of each material, see `NodeRegistry`.
+uniform samplerBuffer colors;
+
 void main() {
-    vec4 vertex = view * model(_vertex, gl_InstanceID);
+    vec4 vertex = view * model(unpack(_vertex), gl_InstanceID);
 
     gl_Position = projection * vertex;
     fogFactor   = getFogFactor(length(vertex.xyz / vertex.w));
-    color       = _color;
+    color       = texelFetch(colors, int(_vertex >> 18));
 }
@@ -5,6 +5,9 @@ Config::Config(LuaJIT * luajit, const char * filename) {
         if (LuaString world_v = config.getitem("world"))
             world = world_v.decode();
 
+        if (LuaString storage_v = config.getitem("storage"))
+            storage = storage_v.decode();
+
         if (LuaTable window_v = config.getitem("window")) {
             if (LuaInteger width_v = window_v.getitem("width"))
                 window.width = width_v.decode();
@@ -54,5 +57,18 @@ Config::Config(LuaJIT * luajit, const char * filename) {
             if (LuaNumber aim_v = gui_v.getitem("aimSize"))
                 gui.aimSize = aim_v.decode();
         }
+
+        if (LuaTable cache_v = config.getitem("cache")) {
+            if (LuaInteger size_v = cache_v.getitem("size"))
+                cache.size = size_v.decode();
+
+            if (LuaBool meshes_v = cache_v.getitem("meshes"))
+                cache.meshes = meshes_v.decode();
+        }
+
+        if (LuaTable clipboard_v = config.getitem("clipboard")) {
+            if (LuaInteger radius_v = clipboard_v.getitem("radius"))
+                clipboard.radius = radius_v.decode();
+        }
     }
 }
\ No newline at end of file
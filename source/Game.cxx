@@ -28,6 +28,11 @@ namespace GUI {
     int aimSize;
 }
 
+namespace Clipboard {
+    Schematic schematic;
+    size_t radius = 1;
+}
+
 namespace Keyboard {
     bool forward  = false;
     bool backward = false;
@@ -1,3 +1,7 @@
+#include <unordered_set>
+#include <ctime>
+#include <bit>
+
 #include <Hyper/Geometry.hxx>
 
 namespace Tesselation {
@@ -138,6 +142,269 @@ namespace Tesselation {
     constexpr Real meter = distance(chunkSize / 2, chunkSize / 2, chunkSize / 2, chunkSize / 2 + 1);
 }
 
+/*
+    Automaton accepting words of `Address` was obtained by breadth-first search over the tesselation:
+    state of a word is the shape of the subtree of chunks whose words start with it, and there are only 17 of them.
+    Row lists states reached by `Up`, `Down`, `Left` & `Right` (−1 means that the word is no longer canonical),
+    e.g. after a turn we can’t turn back immediately and after `LUU` the next `R` is still remembered as a turn.
+
+    Paths of two neighbouring chunks stay close to each other: isometry between their prefixes of the same length
+    (“word difference”) is always one of 17 elements listed in `differences`. Together with the automaton
+    this gives the neighbour’s word by walking backwards until both words meet (see `Address::advance`).
+*/
+namespace Automaton {
+    using namespace Tesselation;
+
+    constexpr size_t size = 17;
+
+    constexpr int8_t δ[size][4] = {
+        { 1,  2,  3,  4}, // ε
+        { 1, -1,  3,  4}, // U
+        {-1,  2,  3,  4}, // D
+        { 5,  6,  3, -1}, // L
+        { 7,  8, -1,  4}, // R
+        { 9, -1,  3, -1}, // LU
+        {-1, 10,  3, -1}, // LD
+        {11, -1, -1,  4}, // RU
+        {-1, 12, -1,  4}, // RD
+        { 1, -1,  3, 13}, // LUU
+        {-1,  2,  3, 14}, // LDD
+        { 1, -1, 15,  4}, // RUU
+        {-1,  2, 16,  4}, // RDD
+        { 7, -1, -1,  4}, // LUUR
+        {-1,  8, -1,  4}, // LDDR
+        { 5, -1,  3, -1}, // RUUL
+        {-1,  6,  3, -1}  // RDDL
+    };
+
+    const std::vector<std::vector<Direction>> differences = {
+        {},
+        {Up, Left}, {Up, Right}, {Down, Left}, {Down, Right},
+        {Left, Up}, {Left, Down}, {Right, Up}, {Right, Down},
+        {Up, Left, Down, Right}, {Up, Right, Down, Left}, {Down, Left, Up, Right}, {Down, Right, Up, Left},
+        {Left, Up, Right, Down}, {Left, Down, Right, Up}, {Right, Up, Left, Down}, {Right, Down, Left, Up}
+    };
+
+    constexpr size_t letters = 4;
+
+    inline Direction direction(size_t x) { return Direction(x + 1); }
+    inline size_t inverse(size_t x) { return x ^ 1; } // U ↔ D, L ↔ R
+
+    // Equality of Möbius transformations, i.e. of matrices up to a scalar.
+    bool same(const Fuchsian<Integer> & A, const Fuchsian<Integer> & B) {
+        const std::array<const ℤi *, 4> α{&A.a, &A.b, &A.c, &A.d}, β{&B.a, &B.b, &B.c, &B.d};
+
+        for (size_t i = 0; i < 4; i++)
+            for (size_t j = i + 1; j < 4; j++)
+                if (!(*α[i] * *β[j] == *α[j] * *β[i])) return false;
+
+        return true;
+    }
+
+    Fuchsian<Integer> evaluate(const std::vector<Direction> & word) {
+        auto retval = I;
+        for (auto d : word) retval *= interpret<Fuchsian<Integer>>(d);
+        return retval;
+    }
+
+    struct Tables {
+        Fuchsian<Integer> ρ; int8_t letter[size];
+
+        int8_t back[size][letters][letters];    // a × Δ × b⁻¹
+        int8_t shorter[letters][letters][2];    // a × x × ρ^β
+        int8_t longer[letters][2][letters];     // x × ρ^β × c⁻¹
+
+        Tables() {
+            ρ = evaluate({Up, Left, Down, Right, Up, Left});
+
+            letter[0] = -1;
+            for (size_t s = 0; s < size; s++)
+                for (size_t x = 0; x < letters; x++)
+                    if (δ[s][x] >= 0) letter[δ[s][x]] = x;
+
+            std::vector<Fuchsian<Integer>> Δ;
+            for (const auto & word : differences) Δ.push_back(evaluate(word));
+
+            auto find = [&](const Fuchsian<Integer> & G) -> int8_t {
+                for (size_t k = 0; k < Δ.size(); k++) if (same(G, Δ[k])) return k;
+                return -1;
+            };
+
+            auto g = [](size_t x) { return interpret<Fuchsian<Integer>>(direction(x)); };
+
+            for (size_t k = 0; k < size; k++)
+                for (size_t a = 0; a < letters; a++)
+                    for (size_t b = 0; b < letters; b++)
+                        back[k][a][b] = find(g(a) * Δ[k] * g(inverse(b)));
+
+            for (size_t x = 0; x < letters; x++)
+                for (size_t β = 0; β < 2; β++)
+                    for (size_t c = 0; c < letters; c++) {
+                        auto G = β ? g(x) * ρ : g(x);
+
+                        shorter[c][x][β] = find(g(c) * G);
+                        longer[x][β][c]  = find(G * g(inverse(c)));
+                    }
+        }
+    };
+
+    const Tables & tables() { static const Tables retval; return retval; }
+}
+
+/*
+    Let W be the word and x the letter, we are looking for the canonical word V of the chunk W × x.
+    Since |V| = |W| ± 1 (each edge crosses exactly one line of the tesselation), for every j ≤ min(|W|, |V|)
+    isometry W[..j]⁻¹ × V[..j] is a word difference, so going from the end we keep track of all pairs
+    (word difference, state of V[..j]) that are still possible until the difference becomes trivial
+    while the state coincides with the state of W[..j]: there both words meet, and the rest of V is read off the pairs.
+
+    Usually they meet within a few steps; the exception is a pair of chunks lying along one of the lines
+    of the tesselation passing near the spawn, whose words may diverge right from the start.
+*/
+bool Address::advance(size_t x) {
+    using namespace Automaton; const auto & T = tables();
+
+    auto n = states.size(); auto s = n > 0 ? states.back() : 0;
+
+    if (n > 0 && T.letter[s] == int8_t(inverse(x))) { states.pop_back(); return false; }
+    if (δ[s][x] >= 0) { states.push_back(δ[s][x]); return false; }
+
+    struct Node { int8_t Δ, state, letter; bool β; ptrdiff_t next; };
+
+    std::vector<Node> nodes; size_t begin = 0; // nodes[begin..] belong to the current level
+
+    auto stateAt = [&](size_t j) -> int8_t { return j > 0 ? states[j - 1] : 0; };
+
+    auto push = [&](const Node & N, size_t j, size_t from) {
+        if (N.Δ < 0 || (j > 0) != (N.state > 0)) return;
+
+        for (auto i = from; i < nodes.size(); i++)
+            if (nodes[i].Δ == N.Δ && nodes[i].state == N.state) return;
+
+        nodes.push_back(N);
+    };
+
+    // V = W[..n] × c
+    for (size_t β = 0; β < 2; β++)
+        for (size_t c = 0; c < letters; c++)
+            for (size_t t = 0; t < size; t++)
+                if (δ[t][c] >= 0) push({T.longer[x][β][c], int8_t(t), int8_t(c), bool(β), -1}, n, 0);
+
+    for (size_t j = n;; j--) {
+        for (auto i = begin; i < nodes.size(); i++) {
+            const auto & N = nodes[i];
+            if (N.Δ != 0 || N.state != stateAt(j)) continue;
+
+            states.resize(j); auto k = ptrdiff_t(i);
+
+            while (k >= 0 && nodes[k].letter >= 0) {
+                states.push_back(δ[stateAt(states.size())][nodes[k].letter]);
+                k = nodes[k].next;
+            }
+
+            return N.β;
+        }
+
+        if (j == 0) break; // should never happen
+
+        auto end = nodes.size(); size_t a = T.letter[states[j - 1]];
+
+        for (auto i = begin; i < end; i++) {
+            auto b = T.letter[nodes[i].state]; if (b < 0) continue;
+
+            for (size_t t = 0; t < size; t++)
+                if (δ[t][b] == nodes[i].state)
+                    push({T.back[nodes[i].Δ][a][b], int8_t(t), b, nodes[i].β, ptrdiff_t(i)}, j - 1, end);
+        }
+
+        // V = W[..j − 1], so that j − 1 = n − 1
+        if (j == n)
+            for (size_t β = 0; β < 2; β++)
+                for (size_t t = 0; t < size; t++)
+                    push({T.shorter[a][x][β], int8_t(t), -1, bool(β), -1}, j - 1, end);
+
+        begin = end;
+    }
+
+    return false;
+}
+
+Address::Address(const Fuchsian<Integer> & G) {
+    using namespace Automaton;
+
+    auto H = G; H.normalize();
+
+    /* Among chunk’s neighbours those lying across a line that separates it from the target are closer to the target,
+       so descending greedily by |H(0)|² = N(b)/N(d) we walk along one of the shortest paths. */
+    auto closer = [](const Fuchsian<Integer> & A, const Fuchsian<Integer> & B)
+    { return A.b.norm() * B.d.norm() < B.b.norm() * A.d.norm(); };
+
+    while (!H.b.isZero()) {
+        size_t x = 0; Fuchsian<Integer> K;
+
+        for (size_t y = 0; y < letters; y++) {
+            auto M = interpret<Fuchsian<Integer>>(direction(inverse(y))) * H; M.normalize();
+            if (y == 0 || closer(M, K)) { x = y; K = M; }
+        }
+
+        *this = *this * direction(x); H = K;
+    }
+
+    // What remains is either identity or a half-turn
+    if (!same(H, I)) twist = !twist;
+}
+
+Fuchsian<Integer> Address::isometry() const {
+    using namespace Automaton; const auto & T = tables();
+
+    auto retval = I;
+
+    for (auto s : states)
+        retval *= interpret<Fuchsian<Integer>>(direction(T.letter[s]));
+
+    if (twist) retval *= T.ρ;
+
+    return retval;
+}
+
+Tesselation::Direction Address::operator[](size_t i) const
+{ return Automaton::direction(Automaton::tables().letter[states[i]]); }
+
+// ρ × x = x⁻¹ × ρ, so in twisted frame every step is reversed.
+Address Address::operator*(Tesselation::Direction d) const {
+    if (d == Tesselation::Identity) return *this;
+
+    auto retval = *this; auto x = size_t(d) - 1;
+    retval.twist ^= retval.advance(twist ? Automaton::inverse(x) : x);
+
+    return retval;
+}
+
+Address Address::operator*(const Address & A) const {
+    using namespace Automaton; const auto & T = tables();
+
+    auto retval = *this;
+
+    for (auto s : A.states) {
+        size_t x = T.letter[s];
+        retval.twist ^= retval.advance(retval.twist ? inverse(x) : x);
+    }
+
+    retval.twist ^= A.twist; return retval;
+}
+
+size_t AddressHash::operator()(const Address & A) const {
+    size_t retval = 0xCBF29CE484222325;
+
+    for (auto s : A.states) { retval ^= s; retval *= 0x100000001B3; }
+
+    return retval;
+}
+
+namespace Tesselation {
+    template<> Address interpret(Direction d) { return Address() * d; }
+}
+
 NodeRegistry::NodeRegistry() {
     attach({"Air", {
         Texture(), Texture(), Texture(),
@@ -145,6 +412,30 @@ NodeRegistry::NodeRegistry() {
     }});
 }
 
+Material NodeRegistry::material(Texture & T) {
+    const vec4 colors[] = {T.lu(), T.ru(), T.rd(), T.ld()};
+
+    for (size_t m = 0; 4 * m < _colors.size(); m++)
+        if (std::equal(colors, colors + 4, _colors.begin() + 4 * m)) return m;
+
+    if (_colors.size() >= 4 * materialLimit) {
+        fprintf(stderr, "Too many distinct textures (at most %zu are allowed)\n", materialLimit);
+        return 0;
+    }
+
+    _colors.insert(_colors.end(), colors, colors + 4);
+    return _colors.size() / 4 - 1;
+}
+
+NodeId NodeRegistry::attach(const NodeDef & def) {
+    auto C = def.cube;
+
+    _materials.push_back({material(C.top), material(C.bottom), material(C.left),
+                          material(C.right), material(C.front), material(C.back)});
+
+    table.push_back(def); return table.size() - 1;
+}
+
 Chunk::Chunk(const Fuchsian<Integer> & origin, const Fuchsian<Integer> & isometry) : _isometry(isometry) {
     /*
         Unfortunately, precomposition of `isometry` with (z ↦ z × exp(iπk/2)) for k ∈ ℤ
@@ -183,170 +474,348 @@ Chunk::Chunk(const Fuchsian<Integer> & origin, const Fuchsian<Integer> & isometr
     }
 
     _pos = isometry.origin();
-    updateMatrix(origin);
+    updateMatrix(origin); _drift = PositionHash()(_pos) % reanchor;
+}
+
+Chunk::~Chunk() { join(); faces.free(); edges.free(); }
 
-    faces.initialize();
-    edges.initialize();
+Chunk * Chunk::neighbour(const Gaussian²<Integer> & pos) const {
+    for (size_t k = 0; k < Tesselation::amount; k++)
+        if (_neighbours[k] != nullptr && _around[k] == pos) return _neighbours[k];
+
+    return nullptr;
 }
 
-Chunk::~Chunk() { join(); delete _blob; faces.free(); edges.free(); }
+void Chunk::unshare() { _blob = std::make_shared<Blob>(*_blob); _shared = false; }
 
 bool Chunk::walkable(Rank x, Real L, Rank z) {
     using namespace Fundamentals;
 
     if (chunkSize <= x || chunkSize <= z) return true;
-    return get(x, Level(Chunk::clamp(L)), z).id == 0;
+
+    auto j = Level(Chunk::clamp(L));
+    return _summary.clear(x, j, j, z) || get(x, j, z).id == 0;
 }
 
-void drawParallelogram(FaceShader::VAO & vao, Texture & T, const Parallelogram<GLfloat> & P, GLfloat h) {
-    auto index = vao.index();
+namespace Packing {
+    using namespace Fundamentals;
+
+    static_assert((chunkSize + 1) * (chunkSize + 1) <= (1 << 9) && worldHeight < (1 << 9));
+    static_assert(4 * NodeRegistry::materialLimit <= (1 << 14));
 
-    vao.emit(T.lu(), P.A.v3(h)); // + 0
-    vao.emit(T.ru(), P.B.v3(h)); // + 1
-    vao.emit(T.rd(), P.C.v3(h)); // + 2
-    vao.emit(T.ld(), P.D.v3(h)); // + 3
+    // Index of the point in `Tesselation::corners` (which is uploaded as a flat table).
+    constexpr GLuint corner(int i, int k) { return i * (chunkSize + 1) + k; }
 
-    vao.push(index); vao.push(index + 1); vao.push(index + 2);
-    vao.push(index); vao.push(index + 2); vao.push(index + 3);
+    constexpr GLuint vertex(GLuint n, int j, GLuint color = 0)
+    { return n | (GLuint(j) << 9) | (color << 18); }
+
+    // Colors of the material in the order of `Texture`.
+    enum Color : GLuint { lu, ru, rd, ld };
+
+    constexpr GLuint color(Material m, Color c) { return 4 * GLuint(m) + c; }
 }
 
-void drawSide(FaceShader::VAO & vao, Texture & T, const Gyrovector<GLfloat> & A, const Gyrovector<GLfloat> & B, GLfloat h₁, GLfloat h₂) {
-    auto index = vao.index();
+void drawParallelogram(FaceShader::Mesh & mesh, Material m, const Parallelogram<GLuint> & P, int h) {
+    using namespace Packing;
 
-    vao.emit(T.rd(), A.v3(h₁)); // + 0
-    vao.emit(T.ru(), A.v3(h₂)); // + 1
-    vao.emit(T.lu(), B.v3(h₂)); // + 2
-    vao.emit(T.ld(), B.v3(h₁)); // + 3
+    auto index = mesh.index();
 
-    vao.push(index); vao.push(index + 1); vao.push(index + 2);
-    vao.push(index); vao.push(index + 2); vao.push(index + 3);
+    mesh.emit(vertex(P.A, h, color(m, lu))); // + 0
+    mesh.emit(vertex(P.B, h, color(m, ru))); // + 1
+    mesh.emit(vertex(P.C, h, color(m, rd))); // + 2
+    mesh.emit(vertex(P.D, h, color(m, ld))); // + 3
+
+    mesh.push(index); mesh.push(index + 1); mesh.push(index + 2);
+    mesh.push(index); mesh.push(index + 2); mesh.push(index + 3);
 }
 
-struct Mask { bool top : 1, bottom : 1, back : 1, front : 1, left : 1, right : 1; };
+void drawSide(FaceShader::Mesh & mesh, Material m, GLuint A, GLuint B, int h₁, int h₂) {
+    using namespace Packing;
 
-void drawRightParallelogrammicPrism(FaceShader::VAO & vao, Cube & C, Mask m, GLfloat h, GLfloat Δh, const Parallelogram<GLfloat> & P) {
-    const auto h₁ = h, h₂ = h + Δh;
+    auto index = mesh.index();
 
-    if (m.top)     drawParallelogram(vao, C.top, P, h₂);
-    if (m.bottom)  drawParallelogram(vao, C.bottom, P.rev(), h₁);
+    mesh.emit(vertex(A, h₁, color(m, rd))); // + 0
+    mesh.emit(vertex(A, h₂, color(m, ru))); // + 1
+    mesh.emit(vertex(B, h₂, color(m, lu))); // + 2
+    mesh.emit(vertex(B, h₁, color(m, ld))); // + 3
 
-    if (m.back)  drawSide(vao, C.back,  P.B, P.A, h₁, h₂);
-    if (m.right) drawSide(vao, C.right, P.C, P.B, h₁, h₂);
-    if (m.front) drawSide(vao, C.front, P.D, P.C, h₁, h₂);
-    if (m.left)  drawSide(vao, C.left,  P.A, P.D, h₁, h₂);
+    mesh.push(index); mesh.push(index + 1); mesh.push(index + 2);
+    mesh.push(index); mesh.push(index + 2); mesh.push(index + 3);
 }
 
-template<typename T> inline Parallelogram<T> parallelogram(Rank i, Rank j) {
-    using namespace Tesselation;
+/*
+    Nodes of a section unpacked for meshing, and its columns as bitmasks of non-air nodes (including the levels
+    right below and above the section), so that exposed faces and visible edges are found for the whole column at once:
+    bit b stands for the level `base + b`.
+*/
+class Slab {
+private:
+    std::array<NodeId, Section::volume> ids;
+    Array²<uint32_t, Fundamentals::chunkSize> columns{}; int base;
+
+public:
+    static constexpr int height = Fundamentals::sectionHeight + 2;
+    static_assert(height <= 32);
+
+    // Levels of the section itself.
+    static constexpr uint32_t body = ((uint32_t(1) << Fundamentals::sectionHeight) - 1) << 1;
+
+    const int section;
+
+    Slab(const Blob & blob, int n) : base(n * Fundamentals::sectionHeight - 1), section(n) {
+        using namespace Fundamentals;
+
+        if (auto S = blob.section(n)) S->unpack(ids.data()); else ids.fill(0);
+
+        for (int i = 0; i < chunkSize; i++) for (int j = 0; j < sectionHeight; j++) for (int k = 0; k < chunkSize; k++)
+            columns[i][k] |= uint32_t(ids[Section::at(i, j, k)] != 0) << (j + 1);
+
+        for (int b : {0, height - 1}) {
+            if (base + b < 0 || base + b > worldTop) continue;
+
+            for (int i = 0; i < chunkSize; i++) for (int k = 0; k < chunkSize; k++)
+                columns[i][k] |= uint32_t(blob.get(i, base + b, k).id != 0) << b;
+        }
+    }
+
+    // Only for the levels of the section.
+    inline NodeId operator()(int i, int j, int k) const { return ids[Section::at(i, j, k)]; }
+
+    // Nodes outside of the chunk (as well as outside of the world) are considered air.
+    inline uint32_t solid(int i, int k) const {
+        using namespace Fundamentals;
+        return (0 <= i && i < chunkSize && 0 <= k && k < chunkSize) ? columns[i][k] : 0;
+    }
+
+    inline uint32_t air(int i, int k) const { return ~solid(i, k); }
+
+    inline int level(int b) const { return base + b; }
+};
+
+struct Mask { bool top : 1, bottom : 1, back : 1, front : 1, left : 1, right : 1; };
+
+inline Parallelogram<GLuint> parallelogram(Rank i, Rank j) {
+    using namespace Packing;
 
     return {
-        corners[i + 0][j + 0], corners[i + 1][j + 0],
-        corners[i + 1][j + 1], corners[i + 0][j + 1]
+        corner(i + 0, j + 0), corner(i + 1, j + 0),
+        corner(i + 1, j + 1), corner(i + 0, j + 1)
     };
 }
 
-void drawNode(FaceShader::VAO & vao, Cube & C, Mask m, Rank x, Level y, Rank z)
-{ drawRightParallelogrammicPrism(vao, C, m, GLfloat(y), 1.0f, parallelogram<GLfloat>(x, z)); }
+// Sides of equal nodes lying one above another, drawn as one quad.
+struct Run { bool open = false; Material material = 0; int h₁ = 0, h₂ = 0; };
 
-void Chunk::emitFaces(NodeRegistry & nodeRegistry) {
+// Merged side stretches its texture vertically, so it’s allowed only if the texture doesn’t change along the height.
+inline bool uniform(const NodeRegistry & nodeRegistry, Material m) {
+    using namespace Packing; auto & C = nodeRegistry.colors();
+    return C[color(m, lu)] == C[color(m, ld)] && C[color(m, ru)] == C[color(m, rd)];
+}
+
+/*
+    Height enters every model linearly (see `shaders/Voxel/Common.glsl`), so a stack of equal sides
+    is exactly one quad (within one section); tops and bottoms aren’t merged, since lines of the grid are curved.
+
+    Only nodes having some exposed face are visited.
+*/
+void emitFaces(FaceShader::Mesh & mesh, const Slab & slab, NodeRegistry & nodeRegistry) {
     using namespace Fundamentals;
 
-    faces.clear();
+    for (int i = 0; i < chunkSize; i++) for (int k = 0; k < chunkSize; k++) {
+        const auto S = slab.solid(i, k), B = S & Slab::body;
+
+        const uint32_t top = B & ~(S >> 1), bottom = B & ~(S << 1);
+        const uint32_t exposed[4] = {B & slab.air(i, k - 1), B & slab.air(i + 1, k),
+                                     B & slab.air(i, k + 1), B & slab.air(i - 1, k)};
 
-    for (int i = 0; i < chunkSize; i++) for (int j = 0; j <= worldTop; j++) for (int k = 0; k < chunkSize; k++) {
-        auto id = get(i, j, k).id;
+        auto P = parallelogram(i, k);
 
-        if (id == 0) continue;
+        const GLuint sides[4][2] = {{P.B, P.A}, {P.C, P.B}, {P.D, P.C}, {P.A, P.D}};
+        Run runs[4]; // back, right, front, left
 
-        Mask mask;
+        auto flush = [&](size_t s) {
+            auto & r = runs[s]; if (!r.open) return;
+            drawSide(mesh, r.material, sides[s][0], sides[s][1], r.h₁, r.h₂); r.open = false;
+        };
 
-        mask.top    = (j == worldTop)      || (get(i + 0, j + 1, k + 0).id == 0);
-        mask.bottom = (j == 0)             || (get(i + 0, j - 1, k + 0).id == 0);
-        mask.back   = (k == 0)             || (get(i + 0, j + 0, k - 1).id == 0);
-        mask.front  = (k == chunkSize - 1) || (get(i + 0, j + 0, k + 1).id == 0);
-        mask.left   = (i == 0)             || (get(i - 1, j + 0, k + 0).id == 0);
-        mask.right  = (i == chunkSize - 1) || (get(i + 1, j + 0, k + 0).id == 0);
+        for (auto rest = top | bottom | exposed[0] | exposed[1] | exposed[2] | exposed[3]; rest != 0; rest &= rest - 1) {
+            const auto bit = rest & -rest; const int j = slab.level(std::countr_zero(rest));
 
-        if (nodeRegistry.has(id)) {
-            auto nodeDef = nodeRegistry.get(id);
-            drawNode(faces, nodeDef.cube, mask, i, j, k);
+            auto id = slab(i, j, k);
+            if (!nodeRegistry.has(id)) continue;
+
+            auto & M = nodeRegistry.materials(id);
+            const int h₁ = j, h₂ = j + 1;
+
+            if (top & bit)    drawParallelogram(mesh, M.top, P, h₂);
+            if (bottom & bit) drawParallelogram(mesh, M.bottom, P.rev(), h₁);
+
+            const Material materials[4] = {M.back, M.right, M.front, M.left};
+
+            for (size_t s = 0; s < 4; s++) {
+                if (!(exposed[s] & bit)) continue;
+
+                auto & r = runs[s];
+                if (r.open && r.material == materials[s] && r.h₂ == h₁ && uniform(nodeRegistry, r.material)) { r.h₂ = h₂; continue; }
+
+                flush(s); r = {true, materials[s], h₁, h₂};
+            }
         }
+
+        for (size_t s = 0; s < 4; s++) flush(s);
     }
 }
 
-inline bool invisible(bool b₀₀, bool b₀₁, bool b₁₀, bool b₁₁)
-{ return (!b₀₀ && !b₀₁ && !b₁₀ && !b₁₁) ||
-          (b₀₀ &&  b₀₁ &&  b₁₀ &&  b₁₁) ||
-         (!b₀₀ && !b₀₁ &&  b₁₀ &&  b₁₁) ||
-          (b₀₀ &&  b₀₁ && !b₁₀ && !b₁₁) ||
-         (!b₀₀ &&  b₀₁ && !b₁₀ &&  b₁₁) ||
-          (b₀₀ && !b₀₁ &&  b₁₀ && !b₁₁); }
+/*
+    Edge is drawn unless four nodes around it are all alike or split by some plane through it into two alike halves.
+    Arguments are bitmasks of air (see `Slab`), so this is decided for all levels at once.
+*/
+inline uint32_t visible(uint32_t b₀₀, uint32_t b₀₁, uint32_t b₁₀, uint32_t b₁₁)
+{ return ~((~(b₀₀ ^ b₀₁) & ~(b₁₀ ^ b₁₁)) | (~(b₀₀ ^ b₁₀) & ~(b₀₁ ^ b₁₁))); }
 
-inline void emitLine(EdgeShader::VAO & vao, vec3 && v1, vec3 && v2) {
-    vao.push(); vao.emit(v1);
-    vao.push(); vao.emit(v2);
+inline void emitLine(EdgeShader::Mesh & mesh, GLuint v1, GLuint v2) {
+    mesh.push(); mesh.emit(v1);
+    mesh.push(); mesh.emit(v2);
 }
 
-void Chunk::emitEdges(NodeRegistry &) {
+void emitEdges(EdgeShader::Mesh & mesh, const Slab & slab) {
     using namespace Fundamentals;
 
-    using namespace Tesselation;
+    using namespace Packing;
 
-    edges.clear();
+    // Horizontal edges at the level j belong to the section of j, the ones on the very top belong to the last section.
+    const uint32_t roof = (slab.section == sectionCount - 1) ? Slab::body | (uint32_t(1) << (Slab::height - 1)) : Slab::body;
 
-    for (int i = 0; i <= chunkSize; i++) for (int j = 0; j < worldHeight; j++) for (int k = 0; k <= chunkSize; k++) {
-        bool b₀₀ = (i == 0         || k == 0)         || get(i - 1, j, k - 1).id == 0;
-        bool b₀₁ = (i == 0         || k == chunkSize) || get(i - 1, j, k + 0).id == 0;
-        bool b₁₀ = (i == chunkSize || k == 0)         || get(i + 0, j, k - 1).id == 0;
-        bool b₁₁ = (i == chunkSize || k == chunkSize) || get(i + 0, j, k + 0).id == 0;
+    for (int i = 0; i <= chunkSize; i++) for (int k = 0; k <= chunkSize; k++) {
+        auto mask = visible(slab.air(i - 1, k - 1), slab.air(i - 1, k), slab.air(i, k - 1), slab.air(i, k)) & Slab::body;
 
-        if (!invisible(b₀₀, b₀₁, b₁₀, b₁₁)) emitLine(edges, corners[i][k].v3(j), corners[i][k].v3(j + 1));
+        for (; mask != 0; mask &= mask - 1) {
+            const int j = slab.level(std::countr_zero(mask));
+            emitLine(mesh, vertex(corner(i, k), j), vertex(corner(i, k), j + 1));
+        }
     }
 
-    for (int i = 0; i < chunkSize; i++) for (int j = 0; j <= worldHeight; j++) for (int k = 0; k <= chunkSize; k++) {
-        bool b₀₀ = (j == 0           || k == 0)         || get(i, j - 1, k - 1).id == 0;
-        bool b₀₁ = (j == 0           || k == chunkSize) || get(i, j - 1, k + 0).id == 0;
-        bool b₁₀ = (j == worldHeight || k == 0)         || get(i, j + 0, k - 1).id == 0;
-        bool b₁₁ = (j == worldHeight || k == chunkSize) || get(i, j + 0, k + 0).id == 0;
+    for (int i = 0; i < chunkSize; i++) for (int k = 0; k <= chunkSize; k++) {
+        auto X = slab.air(i, k - 1), Y = slab.air(i, k);
+        auto mask = visible(X << 1, Y << 1, X, Y) & roof;
 
-        if (!invisible(b₀₀, b₀₁, b₁₀, b₁₁)) emitLine(edges, corners[i][k].v3(j), corners[i + 1][k].v3(j));
+        for (; mask != 0; mask &= mask - 1) {
+            const int j = slab.level(std::countr_zero(mask));
+            emitLine(mesh, vertex(corner(i, k), j), vertex(corner(i + 1, k), j));
+        }
     }
 
-    for (int i = 0; i <= chunkSize; i++) for (int j = 0; j <= worldHeight; j++) for (int k = 0; k < chunkSize; k++) {
-        bool b₀₀ = (j == 0           || i == 0)         || get(i - 1, j - 1, k).id == 0;
-        bool b₀₁ = (j == 0           || i == chunkSize) || get(i + 0, j - 1, k).id == 0;
-        bool b₁₀ = (j == worldHeight || i == 0)         || get(i - 1, j + 0, k).id == 0;
-        bool b₁₁ = (j == worldHeight || i == chunkSize) || get(i + 0, j + 0, k).id == 0;
+    for (int i = 0; i <= chunkSize; i++) for (int k = 0; k < chunkSize; k++) {
+        auto X = slab.air(i - 1, k), Y = slab.air(i, k);
+        auto mask = visible(X << 1, Y << 1, X, Y) & roof;
 
-        if (!invisible(b₀₀, b₀₁, b₁₀, b₁₁)) emitLine(edges, corners[i][k].v3(j), corners[i][k + 1].v3(j));
+        for (; mask != 0; mask &= mask - 1) {
+            const int j = slab.level(std::countr_zero(mask));
+            emitLine(mesh, vertex(corner(i, k), j), vertex(corner(i, k + 1), j));
+        }
+    }
+}
+
+// Each section is meshed separately, so that an edit remeshes only the sections it touches (see `remesh`).
+void Chunk::emit(NodeRegistry & nodeRegistry, Sections sections) {
+    using namespace Fundamentals;
+
+    if (sections == allSections) { faces.clear(); edges.clear(); }
+
+    for (int n = 0; n < sectionCount; n++) {
+        if (!(sections & (Sections(1) << n))) continue;
+
+        auto & F = faces.part(n); F.clear();
+        auto & E = edges.part(n); E.clear();
+
+        const Slab slab(*_blob, n);
+
+        emitFaces(F, slab, nodeRegistry);
+        emitEdges(E, slab);
     }
 }
 
 void Chunk::refresh(NodeRegistry & nodeRegistry) {
-    if (needUpdateVAO) {
+    auto expected = ChunkState::Meshed;
+
+    if (_state.compare_exchange_strong(expected, ChunkState::Ready)) {
+        // Buffers are created only here, so chunks that are never drawn (see `Atlas::pregenerate`) don’t need GL.
+        if (!faces.initialized()) faces.initialize();
+        if (!edges.initialized()) edges.initialize();
+
         faces.upload(GL_DYNAMIC_DRAW);
         edges.upload(GL_DYNAMIC_DRAW);
-
-        needUpdateVAO = false;
-        _needRefresh  = false;
         return;
     }
 
-    if (working()) return; _working = true;
+    expected = ChunkState::Ready;
+    if (!_needRefresh || !_state.compare_exchange_strong(expected, ChunkState::Meshing)) return;
+
+    // Cleared before meshing starts, so that changes made meanwhile are meshed once more.
+    _needRefresh = false;
 
     worker = std::async(std::launch::async, [&nodeRegistry, this]() mutable {
-        emitFaces(nodeRegistry);
-        emitEdges(nodeRegistry);
+        emit(nodeRegistry);
 
-        needUpdateVAO = true;
-        _working = false;
+        _state = ChunkState::Meshed;
     });
 }
 
+/*
+    Edits are remeshed at once on the main thread, but only in the sections they touch (see `around`),
+    and only those parts are uploaded (unless they have outgrown their slots, see `ShaderProgram::VAO`).
+    If the whole chunk is about to be meshed or its fresh mesh isn’t uploaded yet, `refresh` takes care of it.
+*/
+void Chunk::remesh(NodeRegistry & nodeRegistry, Sections sections) {
+    using namespace Fundamentals;
+
+    join(); if (_needRefresh || !ready()) return;
+
+    emit(nodeRegistry, sections);
+
+    if (state() != ChunkState::Ready || !faces.initialized() || !edges.initialized()) return;
+
+    auto upload = [sections](auto & vao) {
+        for (int n = 0; n < sectionCount; n++)
+            if ((sections & (Sections(1) << n)) && !vao.update(n))
+            { vao.upload(GL_DYNAMIC_DRAW); return; }
+    };
+
+    upload(faces); upload(edges);
+}
+
+Sections Chunk::around(Level j) {
+    using namespace Fundamentals;
+
+    Sections retval = 0;
+
+    for (int h = std::max(j - 1, 0); h <= std::min(j + 1, int(worldTop)); h++)
+        retval |= Sections(1) << (h / sectionHeight);
+
+    return retval;
+}
+
+void Chunk::unload() {
+    for (auto s : {ChunkState::Ready, ChunkState::Meshed})
+        if (_state.compare_exchange_strong(s, ChunkState::Unloading)) return;
+}
+
 void Chunk::updateMatrix(const Fuchsian<Integer> & origin) {
     _domain = (origin.inverse() * _isometry).field<Real>();
     _domain.normalize();
 
+    _awayness = _domain.origin().abs(); _drift = 0;
+}
+
+/*
+    When the origin moves to its neighbour Δ, relative transform becomes Δ⁻¹ × origin⁻¹ × isometry,
+    so it’s enough to compose it with Δ⁻¹ in floats. Rounding errors accumulate, so every `reanchor` steps
+    it’s computed exactly again; counters of different chunks start apart, so that they aren’t recomputed all at once.
+*/
+void Chunk::updateMatrix(const Fuchsian<Integer> & origin, const Möbius<Real> & Δ⁻¹) {
+    if (++_drift >= reanchor) { updateMatrix(origin); return; }
+
+    _domain = Δ⁻¹ * _domain; _domain.normalize();
     _awayness = _domain.origin().abs();
 }
 
@@ -359,10 +828,10 @@ inline void uploadDomain(Chunk * chunk, ShaderProgram<Spec> * shader) {
 }
 
 void Chunk::renderFaces(FaceShader * shader, unsigned int count)
-{ uploadDomain(this, shader); faces.drawInstanced(GL_TRIANGLES, count); }
+{ if (faces.count > 0) { uploadDomain(this, shader); faces.drawInstanced(GL_TRIANGLES, count); } }
 
 void Chunk::renderEdges(EdgeShader * shader, unsigned int count)
-{ uploadDomain(this, shader); edges.drawInstanced(GL_LINES, count); }
+{ if (edges.count > 0) { uploadDomain(this, shader); edges.drawInstanced(GL_LINES, count); } }
 
 bool Chunk::touch(const Gyrovector<Real> & w, Rank i, Rank j) {
     const auto & A = Tesselation::corners[i + 0][j + 0];
@@ -411,54 +880,169 @@ std::optional<size_t> Chunk::matchNeighbour(const Gyrovector<Real> & P) {
 Atlas::Atlas() {}
 Atlas::~Atlas() {}
 
-Chunk * Atlas::lookup(const Gaussian²<Integer> & pos) {
-    for (auto chunk : pool)
-        if (chunk->pos() == pos)
-            return chunk;
+inline void mix(size_t & retval, const Integer & n) {
+    if (n.fits()) { retval ^= size_t(n.word()); retval *= 0x100000001B3; return; }
 
-    return nullptr;
+    auto z = n.mpz().get_mpz_t(); auto limbs = mpz_limbs_read(z);
+
+    for (size_t i = 0; i < mpz_size(z); i++) { retval ^= size_t(limbs[i]); retval *= 0x100000001B3; }
+
+    retval ^= size_t(mpz_sgn(z) + 1); retval *= 0x100000001B3;
+}
+
+size_t PositionHash::operator()(const Gaussian²<Integer> & pos) const {
+    size_t retval = 0xCBF29CE484222325;
+
+    mix(retval, pos.first.real);  mix(retval, pos.first.imag);
+    mix(retval, pos.second.real); mix(retval, pos.second.imag);
+
+    return retval;
+}
+
+Chunk * Atlas::lookup(const Gaussian²<Integer> & pos) {
+    auto it = index.find(pos);
+    return it == index.end() ? nullptr : it->second;
 }
 
 Chunk * Atlas::poll(const Fuchsian<Integer> & origin, const Fuchsian<Integer> & isometry) {
     auto pos = isometry.origin();
 
+    if (auto chunk = lookup(pos)) return chunk;
+
+    auto chunk = new Chunk(origin, isometry); pool.push_back(chunk); index.emplace(pos, chunk); link(chunk);
+    chunk->load(generator, store, &blobs, cache.take(pos)); return chunk;
+}
+
+// Being neighbours is a symmetric relation, so resident neighbours are linked back as well.
+void Atlas::link(Chunk * chunk) {
+    for (size_t k = 0; k < Tesselation::amount; k++) {
+        chunk->_around[k] = (chunk->_isometry * Tesselation::neighbours[k]).origin();
+
+        if (auto N = lookup(chunk->_around[k])) {
+            chunk->_neighbours[k] = N;
+
+            for (size_t j = 0; j < Tesselation::amount; j++)
+                if (N->_around[j] == chunk->_pos) N->_neighbours[j] = chunk;
+        }
+    }
+}
+
+void Atlas::unlink(Chunk * chunk) {
+    for (auto N : chunk->_neighbours)
+        if (N != nullptr)
+            for (auto & M : N->_neighbours)
+                if (M == chunk) M = nullptr;
+}
+
+// Chunk must be clean, it’s moved into the cache (if enabled) and deleted.
+std::vector<Chunk *>::iterator Atlas::unload(std::vector<Chunk *>::iterator it) {
+    auto chunk = *it;
+
+    if (cache.capacity > 0) {
+        auto entry = chunk->stash(cache.meshes);
+        if (entry != nullptr) cache.put(chunk->pos(), entry);
+    }
+
+    unlink(chunk); index.erase(chunk->pos()); delete chunk; return pool.erase(it);
+}
+
+std::array<size_t, chunkStates> Atlas::census() const {
+    std::array<size_t, chunkStates> retval{};
+
     for (auto chunk : pool)
-        if (chunk->pos() == pos)
-            return chunk;
+        retval[size_t(chunk->state())]++;
 
-    auto chunk = new Chunk(origin, isometry); pool.push_back(chunk);
-    chunk->load(generator, engine); return chunk;
+    return retval;
 }
 
 void Atlas::updateMatrix(const Fuchsian<Integer> & origin) {
+    auto Δ = anchor.inverse() * origin; Δ.normalize(); anchor = origin;
+
+    for (size_t k = 0; k < Tesselation::neighbours.size(); k++)
+        if (Automaton::same(Δ, Tesselation::neighbours[k])) {
+            Möbius<Real> Δ⁻¹(Tesselation::neighbours⁻¹[k]);
+
+            for (auto chunk : pool)
+                chunk->updateMatrix(origin, Δ⁻¹);
+
+            return;
+        }
+
     for (auto chunk : pool)
         chunk->updateMatrix(origin);
 }
 
-const char * initcmd   = "CREATE TABLE IF NOT EXISTS atlas("
-                         "bitfield INTEGER, real1 BLOB, imag1 BLOB, real2 BLOB, imag2 BLOB,"
-                         "blob BLOB, PRIMARY KEY (bitfield, real1, imag1, real2, imag2));",
-           * loadcmd   = "SELECT blob FROM atlas WHERE bitfield = ? AND real1 = ? AND imag1 = ? AND real2 = ? AND imag2 = ?;",
-           * insertcmd = "INSERT or REPLACE INTO atlas(bitfield, real1, imag1, real2, imag2, blob) VALUES(?, ?, ?, ?, ?, ?);";
+void Atlas::connect(const std::string & storage, const std::string & filename)
+{ store = ChunkStore::open(storage, filename); world = filename; }
 
-inline void warn(sqlite3 * engine)
-{ std::fprintf(stderr, "SQLITE: %s\n", sqlite3_errmsg(engine)); }
+bool Atlas::backup(const std::string & filename) {
+    if (store == nullptr) return false;
 
-void Atlas::connect(std::string & filename) {
-    auto retval = sqlite3_open(filename.c_str(), &engine);
+    if (!filename.empty()) return store->backup(filename);
 
-    if (retval != SQLITE_OK) {
-        warn(engine); sqlite3_close(engine);
-        throw std::runtime_error("`sqlite3_open` failed");
-    }
+    char timestamp[32]; auto t = std::time(nullptr);
+    std::strftime(timestamp, sizeof(timestamp), "%Y%m%d-%H%M%S", std::localtime(&t));
+
+    return store->backup(world + "." + timestamp + ".backup");
+}
+
+/*
+    Chunks are enumerated by breadth-first search over `Tesselation::Neighbours` using `Address`
+    (so that it doesn’t slow down with the distance), those missing in the store are generated
+    on all cores without touching GL (nor the pool).
+*/
+std::pair<size_t, size_t> Atlas::pregenerate(size_t radius) {
+    if (store == nullptr) return {0, 0};
 
-    char * errmsg; retval = sqlite3_exec(engine, initcmd, nullptr, 0, &errmsg);
+    const auto neighbours = Tesselation::eval<Address, Tesselation::Neighbours>();
 
-    if (retval != SQLITE_OK) {
-        std::fprintf(stderr, "SQLITE: %s\n", errmsg); sqlite3_free(errmsg);
+    std::vector<Address> chunks{Address()};
+    std::unordered_set<Address, AddressHash> seen{Address()};
 
-        throw std::runtime_error("sqlite3 initialization failed");
+    for (size_t step = 0, begin = 0; step < radius; step++) {
+        auto end = chunks.size();
+
+        for (auto i = begin; i < end; i++)
+            for (const auto & Δ : neighbours) {
+                auto A = chunks[i] * Δ;
+                if (seen.insert(A).second) chunks.push_back(A);
+            }
+
+        begin = end;
     }
+
+    constexpr size_t batch   = 256;  // chunks per transaction
+    constexpr size_t backlog = 1024; // chunks waiting for the writer at most, each holds a whole `Blob`
+
+    std::atomic<size_t> next = 0, generated = 0; std::mutex mutex;
+
+    auto work = [&]() {
+        Blob existing; Sections stale;
+
+        for (size_t i; (i = next++) < chunks.size();) {
+            Chunk chunk(Tesselation::I, chunks[i].isometry());
+            if (store->load(chunk.pos(), existing, stale)) continue;
+
+            chunk.generate(generator);
+
+            {
+                std::lock_guard<std::mutex> guard(mutex);
+
+                store->push(chunk.pos(), *chunk.blob(), chunk.dirtySections());
+                if (++generated % batch == 0) store->submit();
+            }
+
+            while (store->depth() > backlog)
+                std::this_thread::sleep_for(std::chrono::milliseconds(1));
+        }
+    };
+
+    std::vector<std::thread> workers(std::max(1U, std::thread::hardware_concurrency()));
+
+    for (auto & worker : workers) worker = std::thread(work);
+    for (auto & worker : workers) worker.join();
+
+    store->submit(); return {generated, chunks.size()};
 }
 
 void Atlas::disconnect() {
@@ -467,87 +1051,159 @@ void Atlas::disconnect() {
     for (auto chunk : pool)
         chunk->join();
 
-    sqlite3_close(engine);
+    cache.clear(); delete store; store = nullptr;
+}
+
+void Chunk::load(ChunkOperator * generator, ChunkStore * store, BlobPool * blobs, ChunkCache::Entry * cached) {
+    if (worker.valid()) return;
+
+    worker = std::async(std::launch::async, [generator, store, blobs, cached, this]() mutable {
+        _blob = std::make_shared<Blob>(); Sections stale = 0; bool meshed = false;
+
+        if (cached != nullptr && Encoding::decode(*_blob, cached->data.data(), cached->data.size())) {
+            _summary.build(*_blob);
+
+            if (cached->meshed) {
+                faces.parts = std::move(cached->faces);
+                edges.parts = std::move(cached->edges);
+
+                meshed = true;
+            }
+        } else if (store == nullptr || !store->load(_pos, *_blob, stale)) generate(generator);
+        else { _dirty = stale; _summary.build(*_blob); }
+
+        delete cached;
+
+        if (blobs != nullptr) { _blob = blobs->intern(std::move(_blob)); _shared = true; }
+
+        if (!meshed) requestRefresh();
+        _state = meshed ? ChunkState::Meshed : ChunkState::Ready;
+    });
 }
 
-inline void dumpBlob(sqlite3_stmt * statement, int index, void * blob, size_t n) {
-    static uint8_t zero = 0;
+// Fills fresh blob using given generator, the result is to be saved entirely.
+void Chunk::generate(ChunkOperator * generator) {
+    _blob = std::make_shared<Blob>(); _shared = false; _summary.clear();
 
-    if (blob == nullptr || n == 0)
-        sqlite3_bind_blob(statement, index, &zero, 1, SQLITE_STATIC);
-    else
-        sqlite3_bind_blob(statement, index, blob, n, free);
+    if (generator != nullptr) (*generator)(this);
+    _dirty = Fundamentals::allSections;
 }
 
-void dumpGaussian(sqlite3_stmt * statement, const Gaussian<Integer> & z, int idx₁, int idx₂) {
-    size_t k₁, k₂;
+void Chunk::markDirty(Sections sections) {
+    if (_shared) unshare();
 
-    auto blob₁ = Math::serialize(z.real, k₁);
-    auto blob₂ = Math::serialize(z.imag, k₂);
+    _dirty |= sections; _summary.build(*_blob);
 
-    dumpBlob(statement, idx₁, blob₁, k₁);
-    dumpBlob(statement, idx₂, blob₂, k₂);
+    for (size_t s = 0; s < Fundamentals::sectionCount; s++)
+        if (!_blob->empty(s) && _summary.occupancy(s) == 0) _blob->clear(s);
 }
 
-void Chunk::serialize(sqlite3_stmt * statement, int idx₀, int idx₁, int idx₂, int idx₃, int idx₄) {
-    Bitfield<uint8_t> bitfield(0);
+void Chunk::join() { if (worker.valid()) worker.wait(); }
+
+// Meshes are kept only if they are up to date, vertex data is moved out, so the chunk should be deleted afterwards.
+ChunkCache::Entry * Chunk::stash(bool meshes) {
+    join(); if (state() == ChunkState::Loading || _blob == nullptr) return nullptr;
 
-    bitfield.set(0, Math::isNeg(_pos.first.real));
-    bitfield.set(1, Math::isNeg(_pos.first.imag));
-    bitfield.set(2, Math::isNeg(_pos.second.real));
-    bitfield.set(3, Math::isNeg(_pos.second.imag));
+    auto entry = new ChunkCache::Entry();
+    entry->data = Encoding::encode(*_blob);
 
-    sqlite3_bind_int(statement, idx₀, uint8_t(bitfield));
-    dumpGaussian(statement, _pos.first,  idx₁, idx₂);
-    dumpGaussian(statement, _pos.second, idx₃, idx₄);
+    if (meshes && !_needRefresh) {
+        entry->faces = std::move(faces.parts); faces.parts.clear();
+        entry->edges = std::move(edges.parts); edges.parts.clear();
+
+        entry->meshed = true;
+    }
+
+    return entry;
 }
 
-void Chunk::load(ChunkOperator * generator, sqlite3 * engine) {
-    sqlite3_stmt * statement = nullptr;
+std::shared_ptr<Blob> BlobPool::intern(std::shared_ptr<Blob> blob) {
+    auto digest = blob->digest();
 
-    if (_ready) return; _working = true;
-    worker = std::async(std::launch::async, [statement, retval = 0, generator, engine, this]() mutable {
-        _blob = new Blob();
+    std::lock_guard<std::mutex> guard(mutex);
 
-        retval = sqlite3_prepare_v2(engine, loadcmd, -1, &statement, nullptr);
-        if (retval != SQLITE_OK) { warn(engine); _needUnload = true; goto fin; }
+    // Entries of blobs no longer used are dropped whenever the table doubles.
+    if (table.size() > 2 * swept) {
+        std::erase_if(table, [](const auto & item) { return item.second.expired(); });
+        swept = std::max<size_t>(table.size(), 64);
+    }
 
-        serialize(statement, 1, 2, 3, 4, 5);
-        retval = sqlite3_step(statement);
+    auto & slot = table[digest];
 
-        if (retval == SQLITE_ROW)
-            memcpy(_blob, sqlite3_column_blob(statement, 0), sizeof(Blob));
-        else { if (generator != nullptr) (*generator)(this); _dirty = true; }
+    if (auto retval = slot.lock()) {
+        if (*retval == *blob) return retval;
+        return blob; // hash collision, such blob just stays private
+    }
+
+    slot = blob; return blob;
+}
 
-        if (retval == SQLITE_ERROR) warn(engine);
-        sqlite3_finalize(statement); requestRefresh();
+size_t BlobPool::size() {
+    std::lock_guard<std::mutex> guard(mutex);
 
-        fin: _ready = true; _working = false;
-    });
+    return std::count_if(table.begin(), table.end(), [](const auto & item) { return !item.second.expired(); });
 }
 
-void Chunk::join() { worker.wait(); }
+size_t ChunkCache::Entry::size() const {
+    size_t retval = sizeof(Entry) + data.size();
 
-void Chunk::dump(sqlite3 * engine) {
-    sqlite3_stmt * statement = nullptr;
+    for (const auto & mesh : faces) retval += mesh.bytes();
+    for (const auto & mesh : edges) retval += mesh.bytes();
 
-    if (working()) return; _working = true;
-    worker = std::async(std::launch::async, [statement, retval = 0, engine, this]() mutable {
-        retval = sqlite3_prepare_v2(engine, insertcmd, -1, &statement, nullptr);
-        if (retval != SQLITE_OK) { warn(engine); _working = false; return; }
+    return retval;
+}
 
-        serialize(statement, 1, 2, 3, 4, 5);
-        sqlite3_bind_blob(statement, 6, _blob, sizeof(Blob), SQLITE_TRANSIENT);
+ChunkCache::~ChunkCache() { clear(); }
 
-        retval = sqlite3_step(statement);
+void ChunkCache::put(const Gaussian²<Integer> & pos, Entry * entry) {
+    auto key = Encoding::key(pos);
 
-        if (retval != SQLITE_DONE) warn(engine); else _dirty = false;
-        sqlite3_finalize(statement); _working = false;
-    });
+    if (auto it = index.find(key); it != index.end()) {
+        total -= it->second->second->size(); delete it->second->second;
+        order.erase(it->second); index.erase(it);
+    }
+
+    total += entry->size(); order.emplace_front(key, entry); index[key] = order.begin();
+
+    while (total > capacity && !order.empty()) {
+        auto & [victim, data] = order.back();
+
+        total -= data->size(); delete data;
+        index.erase(victim); order.pop_back();
+    }
+}
+
+ChunkCache::Entry * ChunkCache::take(const Gaussian²<Integer> & pos) {
+    if (capacity == 0) return nullptr;
+
+    auto it = index.find(Encoding::key(pos));
+    if (it == index.end()) { _misses++; return nullptr; }
+
+    auto entry = it->second->second; total -= entry->size();
+    order.erase(it->second); index.erase(it); _hits++;
+
+    return entry;
+}
+
+void ChunkCache::clear() {
+    for (auto & [key, entry] : order)
+        delete entry;
+
+    order.clear(); index.clear(); total = 0;
+}
+
+void Chunk::dump(ChunkStore * store) {
+    // State is checked first: acquiring it orders the worker’s writes of `_dirty` before the reads below.
+    if (state() == ChunkState::Loading || _blob == nullptr || _dirty == 0) return;
+
+    store->push(_pos, *_blob, _dirty); _dirty = 0;
 }
 
 void Atlas::dump() {
+    if (store == nullptr) return;
+
     for (auto chunk : pool)
-        if (chunk->dirty())
-            chunk->dump(engine);
-}
\ No newline at end of file
+        chunk->dump(store);
+
+    store->submit();
+}
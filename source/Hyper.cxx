@@ -1,4 +1,6 @@
+#include <cstring>
 #include <cstdio>
+#include <chrono>
 
 #include <glm/ext/matrix_clip_space.hpp>
 #include <glm/ext/matrix_transform.hpp>
@@ -25,6 +27,10 @@ EdgeShader  * edgeShader  = nullptr;
 
 DummyShader::VAO aimVao;
 
+// Positions of grid’s corners and colors of materials, looked up by packed vertices (see `FaceShaderSpec`).
+TBO<vec2> cornerTable(GL_RG32F, 0);
+TBO<vec4> colorTable(GL_RGBA32F, 1);
+
 PBO<GLfloat, Action> pbo(GL_DEPTH_COMPONENT, 1, 1);
 
 const auto origin = vec2(0.0f);
@@ -39,10 +45,12 @@ void drawAim(DummyShader::VAO & vao) {
 
     auto wpixel = 1.0 / GLfloat(Window::width), hpixel = 1.0 / GLfloat(Window::height);
 
-    vao.push(); vao.emit(vec3(-GLfloat(GUI::aimSize) * wpixel, 0, 0), white, origin, 1.0f);
-    vao.push(); vao.emit(vec3(+GLfloat(GUI::aimSize) * wpixel, 0, 0), white, origin, 1.0f);
-    vao.push(); vao.emit(vec3(0, -GLfloat(GUI::aimSize) * hpixel, 0), white, origin, 1.0f);
-    vao.push(); vao.emit(vec3(0, +GLfloat(GUI::aimSize) * hpixel, 0), white, origin, 1.0f);
+    auto & mesh = vao.part();
+
+    mesh.push(); mesh.emit(vec3(-GLfloat(GUI::aimSize) * wpixel, 0, 0), white, origin, 1.0f);
+    mesh.push(); mesh.emit(vec3(+GLfloat(GUI::aimSize) * wpixel, 0, 0), white, origin, 1.0f);
+    mesh.push(); mesh.emit(vec3(0, -GLfloat(GUI::aimSize) * hpixel, 0), white, origin, 1.0f);
+    mesh.push(); mesh.emit(vec3(0, +GLfloat(GUI::aimSize) * hpixel, 0), white, origin, 1.0f);
 
     vao.upload(GL_STATIC_DRAW);
 }
@@ -90,14 +98,13 @@ std::optional<std::pair<Chunk *, Gyrovector<Real>>> getNeighbour(const Gyrovecto
         return std::optional(std::pair(Game::player.chunk(), Q));
     }
 
-    for (size_t k = 0; k < Tesselation::neighbours.size(); k++) {
-        auto G = Game::player.chunk()->isometry() * Tesselation::neighbours[k];
-        if (auto C = Game::atlas.lookup(G.origin())) {
-            auto Q = C->domain().inverse().apply(P);
+    for (auto C : Game::player.chunk()->neighbours()) {
+        if (C == nullptr) continue;
 
-            if (Chunk::isInsideOfDomain(Q))
-                return std::optional(std::pair(C, Q));
-        }
+        auto Q = C->domain().inverse().apply(P);
+
+        if (Chunk::isInsideOfDomain(Q))
+            return std::optional(std::pair(C, Q));
     }
 
     return std::nullopt;
@@ -115,12 +122,14 @@ void setBlock(Chunk * C, Rank i, Real L, Rank k, NodeId id) {
     if (id != 0 && C->get(i, j, k).id != 0)
         return;
 
+    C->join(); // meshing reads nodes meanwhile, but `set` may repack the section
+
     C->set(i, j, k, {id});
 
     if (Game::player.stuck())
         C->set(i, j, k, {0});
 
-    C->requestRefresh();
+    C->remesh(Game::Registry::node, Chunk::around(j));
 }
 
 void click(const Aut𝔻<Real> & origin, const GLfloat zbuffer, const Action action) {
@@ -151,6 +160,8 @@ void pollNeighbours() {
     atlas.updateMatrix(player.camera().position.action());
 
     for (size_t k = 0; k < Tesselation::neighbours.size(); k++) {
+        if (player.chunk()->neighbour(k) != nullptr) continue;
+
         auto G = player.chunk()->isometry() * Tesselation::neighbours[k];
         atlas.poll(player.camera().position.action(), G);
     }
@@ -201,17 +212,15 @@ void display(GLFWwindow * window) {
     for (auto it = atlas.pool.begin(); it != atlas.pool.end();) {
         auto chunk = *it;
 
-        if (!chunk->ready()) { it++; continue; }
-
         if (chunk->needRefresh())
             chunk->refresh(Registry::node);
 
         if (Render::hmax < chunk->awayness())
             chunk->unload();
 
-        if (chunk->needUnload() && !chunk->dirty()) {
-            delete chunk; it = atlas.pool.erase(it);
-        } else it++;
+        if (chunk->state() == ChunkState::Unloading && !chunk->dirty())
+            it = atlas.unload(it);
+        else it++;
     }
 
     auto origin = player.camera().position.domain().inverse();
@@ -243,6 +252,10 @@ void display(GLFWwindow * window) {
 
     unsigned int nvert = 2 * Render::vmax + 1;
 
+    // Scripts may register new nodes at any moment.
+    if (colorTable.size() != Registry::node.colors().size())
+        colorTable.upload(Registry::node.colors());
+
     faceShader->activate();
     uploadMVP(faceShader, origin);
 
@@ -333,45 +346,20 @@ void windowFocusCallback(GLFWwindow * window, int focused) {
     if (!Window::focused) freeMouse(window);
 }
 
-Blob blobBuffer;
-
-void copyBlob() {
+void copySchematic() {
     using namespace Game;
 
-    const auto & src = *player.chunk();
-    if (src.blob() == nullptr) return;
-
-    memcpy(&blobBuffer, src.blob(), sizeof(Blob));
+    Clipboard::schematic.copy(atlas, player.chunk(), Clipboard::radius);
 }
 
-void pasteBlob() {
+// Only pasted chunks are remeshed, since meshes don’t depend on neighbours.
+void pasteSchematic() {
     using namespace Game;
 
-    auto dest = player.chunk()->blob();
-    if (dest == nullptr) return;
-
-    memcpy(dest, &blobBuffer, sizeof(Blob));
-    player.chunk()->requestRefresh();
+    Clipboard::schematic.paste(atlas, player.camera().position.action(), player.chunk());
 }
 
-void rotateBlob() {
-    using namespace Game;
-    using namespace Fundamentals;
-
-    auto src = player.chunk()->blob();
-    if (src == nullptr) return;
-
-    auto buf = new Blob; memcpy(buf, src, sizeof(Blob));
-
-    for (size_t i = 0; i < chunkSize; i++)
-        for (size_t j = 0; j < worldHeight; j++)
-            for (size_t k = 0; k < chunkSize; k++)
-                src->data[i][j][k] = buf->data[k][j][chunkSize - 1 - i];
-
-    delete buf;
-
-    player.chunk()->requestRefresh();
-}
+void rotateSchematic() { Game::Clipboard::schematic.rotate(); }
 
 const Real elevationRate = 3.0;
 
@@ -414,6 +402,12 @@ inline void toggleNoclip() {
     player.noclip = !player.noclip;
 }
 
+void backupWorld() {
+    using namespace Game;
+
+    if (!atlas.backup()) std::fprintf(stderr, "Backup is already running\n");
+}
+
 void keyboardCallback(GLFWwindow * window, int key, int scancode, int action, int mods) {
     using namespace Game;
 
@@ -442,9 +436,10 @@ void keyboardCallback(GLFWwindow * window, int key, int scancode, int action, in
         case GLFW_KEY_7:          hotbarSelect(6);     break;
         case GLFW_KEY_8:          hotbarSelect(7);     break;
         case GLFW_KEY_9:          hotbarSelect(8);     break;
-        case GLFW_KEY_X:          rotateBlob();        break;
-        case GLFW_KEY_C:          copyBlob();          break;
-        case GLFW_KEY_V:          pasteBlob();         break;
+        case GLFW_KEY_X:          rotateSchematic();   break;
+        case GLFW_KEY_C:          copySchematic();     break;
+        case GLFW_KEY_V:          pasteSchematic();    break;
+        case GLFW_KEY_B:          backupWorld();       break;
         case GLFW_KEY_BACKSLASH:  freeMouse(window);   break;
         case GLFW_KEY_SPACE:      pressSpace();        break;
         case GLFW_KEY_LEFT_SHIFT: pressLShift();       break;
@@ -594,6 +589,7 @@ inline void uploadPrims(ShaderProgram<Spec> * shader, Config & config) {
     shader->uniform("vrd",         float(config.camera.verticalRenderDistance));
     shader->uniform("hrd",         float(config.camera.horizontalRenderDistance));
     shader->uniform("worldHeight", float(Fundamentals::worldHeight));
+    shader->uniform("corners",     cornerTable.index());
 
     shader->uniform("fog.enabled", config.fog.enabled);
     shader->uniform("fog.near",    config.fog.near);
@@ -603,6 +599,7 @@ inline void uploadPrims(ShaderProgram<Spec> * shader, Config & config) {
 
 void setupShaders(Config & config) {
     faceShader->activate(); uploadPrims(faceShader, config);
+    faceShader->uniform("colors", colorTable.index());
     edgeShader->activate(); uploadPrims(edgeShader, config);
 }
 
@@ -617,6 +614,15 @@ void setupGL(GLFWwindow * window, Config & config) {
 
     glEnable(GL_BLEND);
 
+    std::vector<vec2> corners;
+
+    for (const auto & row : Tesselation::corners)
+        for (const auto & P : row)
+            corners.push_back(vec2(P.x(), P.y()));
+
+    cornerTable.initialize(); cornerTable.upload(corners);
+    colorTable.initialize();
+
     uploadShaders();
     setupShaders(config);
 
@@ -660,8 +666,6 @@ void setupGame(Config & config) {
     using namespace Tesselation;
     using namespace Game;
 
-    atlas.generator = &buildFloor;
-
     Render::vmax = config.camera.verticalRenderDistance;
     Render::hmax = chunkDiameter(config.camera.horizontalRenderDistance);
 
@@ -677,6 +681,9 @@ void cleanUp(GLFWwindow * window) {
     pbo.free();
     aimVao.free();
 
+    cornerTable.free();
+    colorTable.free();
+
     delete dummyShader;
     delete faceShader;
     delete edgeShader;
@@ -685,6 +692,34 @@ void cleanUp(GLFWwindow * window) {
     glfwTerminate();
 }
 
+// Headless mode: Hyper --pregenerate <world> <radius> [script.lua …]
+int pregenerate(LuaJIT & luajit, Config & config, int argc, char * argv[]) {
+    using namespace Game;
+
+    if (argc < 4) {
+        fprintf(stderr, "Usage: %s --pregenerate <world> <radius> [script.lua ...]\n", argv[0]);
+        return 1;
+    }
+
+    auto radius = strtoul(argv[3], nullptr, 10);
+
+    luajit.loadapi();
+
+    for (int i = 4; i < argc; i++)
+        luajit.go(argv[i]);
+
+    auto start = std::chrono::steady_clock::now();
+
+    atlas.connect(config.storage, argv[2]);
+    auto [generated, visited] = atlas.pregenerate(radius);
+    atlas.disconnect();
+
+    std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+    printf("Generated %zu of %zu chunks within radius %lu in %.1f s\n", generated, visited, radius, elapsed.count());
+
+    return 0;
+}
+
 int main(int argc, char * argv[]) {
     using namespace Game;
 
@@ -692,6 +727,11 @@ int main(int argc, char * argv[]) {
 
     Config config(&luajit, "config.lua");
 
+    atlas.generator = &buildFloor; // scripts may replace it with `core.generator`
+
+    if (argc > 1 && strcmp(argv[1], "--pregenerate") == 0)
+        return pregenerate(luajit, config, argc, argv);
+
     auto window = setupWindow(config);
     setupGL(window, config);
 
@@ -700,7 +740,12 @@ int main(int argc, char * argv[]) {
     for (int i = 1; i < argc; i++)
         luajit.go(argv[i]);
 
-    atlas.connect(config.world);
+    atlas.cache.capacity = config.cache.size << 20;
+    atlas.cache.meshes   = config.cache.meshes;
+
+    Clipboard::radius = config.clipboard.radius;
+
+    atlas.connect(config.storage, config.world);
     setupGame(config);
     setupSheet();
 
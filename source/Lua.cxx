@@ -2,6 +2,8 @@
 #include <string.h>
 #include <stdio.h>
 
+#include <mutex>
+
 #include <Hyper/Game.hxx>
 #include <Lua.hxx>
 
@@ -147,6 +149,107 @@ namespace API {
         return 0;
     }
 
+    // backup([filename]) → boolean, the copy is written in background
+    static int backup(lua_State * vm) {
+        auto filename = luaL_optstring(vm, 1, "");
+
+        lua_pushboolean(vm, Game::atlas.backup(filename));
+        return 1;
+    }
+
+    // census() → {loading = …, ready = …, meshing = …, meshed = …, unloading = …}, number of resident chunks in each state
+    static int census(lua_State * vm) {
+        static const char * names[chunkStates] = {"loading", "ready", "meshing", "meshed", "unloading"};
+
+        auto counts = Game::atlas.census(); lua_createtable(vm, 0, chunkStates);
+
+        for (size_t k = 0; k < chunkStates; k++)
+        { lua_pushinteger(vm, counts[k]); lua_setfield(vm, -2, names[k]); }
+
+        return 1;
+    }
+
+    // storage() → {depth = …, flushes = …, latency = …} or nil if the world isn’t saved, see `ChunkStore`
+    static int storage(lua_State * vm) {
+        auto store = Game::atlas.persistence();
+        if (store == nullptr) { lua_pushnil(vm); return 1; }
+
+        lua_createtable(vm, 0, 3);
+
+        lua_pushinteger(vm, store->depth());   lua_setfield(vm, -2, "depth");   // chunks waiting to be written
+        lua_pushinteger(vm, store->flushes()); lua_setfield(vm, -2, "flushes");
+        lua_pushnumber(vm,  store->latency()); lua_setfield(vm, -2, "latency"); // of the last flush, in seconds
+
+        return 1;
+    }
+
+    // saveSchematic(filename) → boolean, writes the clipboard (see `Schematic`)
+    static int saveSchematic(lua_State * vm) {
+        lua_pushboolean(vm, Game::Clipboard::schematic.save(luaL_checkstring(vm, 1)));
+        return 1;
+    }
+
+    // loadSchematic(filename) → boolean, the clipboard is kept as it is if the file is unreadable
+    static int loadSchematic(lua_State * vm) {
+        lua_pushboolean(vm, Game::Clipboard::schematic.load(luaL_checkstring(vm, 1)));
+        return 1;
+    }
+
+    // Lua generator runs on chunk loading threads, so its calls are serialized.
+    static lua_State * generatorVM = nullptr; static int generatorRef = LUA_NOREF;
+    static std::mutex generatorMutex;
+
+    static Chunk * generate(Chunk * chunk) {
+        std::lock_guard<std::mutex> guard(generatorMutex);
+
+        lua_rawgeti(generatorVM, LUA_REGISTRYINDEX, generatorRef);
+        lua_pushlightuserdata(generatorVM, chunk);
+
+        if (auto error = lua_pcall(generatorVM, 1, 0, 0))
+            warning(generatorVM, error);
+
+        return chunk;
+    }
+
+    // generator(function (chunk) … end) replaces the built-in one
+    static int generator(lua_State * vm) {
+        luaL_checktype(vm, 1, LUA_TFUNCTION);
+
+        luaL_unref(vm, LUA_REGISTRYINDEX, generatorRef);
+        lua_pushvalue(vm, 1); generatorRef = luaL_ref(vm, LUA_REGISTRYINDEX); generatorVM = vm;
+
+        Game::atlas.generator = &generate;
+        return 0;
+    }
+
+    static Chunk * checkChunk(lua_State * vm, int argn, lua_Integer & i, lua_Integer & j, lua_Integer & k) {
+        using namespace Fundamentals;
+        luaL_checktype(vm, argn, LUA_TLIGHTUSERDATA);
+
+        i = luaL_checkinteger(vm, argn + 1); luaL_argcheck(vm, 0 <= i && i < lua_Integer(chunkSize),   argn + 1, "out of chunk");
+        j = luaL_checkinteger(vm, argn + 2); luaL_argcheck(vm, 0 <= j && j < lua_Integer(worldHeight), argn + 2, "out of chunk");
+        k = luaL_checkinteger(vm, argn + 3); luaL_argcheck(vm, 0 <= k && k < lua_Integer(chunkSize),   argn + 3, "out of chunk");
+
+        return static_cast<Chunk *>(lua_touserdata(vm, argn));
+    }
+
+    // setNode(chunk, i, j, k, id), only valid inside of generator
+    static int setNode(lua_State * vm) {
+        lua_Integer i, j, k; auto chunk = checkChunk(vm, 1, i, j, k);
+        auto id = luaL_checkinteger(vm, 5);
+
+        chunk->set(i, j, k, {NodeId(id)});
+        return 0;
+    }
+
+    // getNode(chunk, i, j, k) → id
+    static int getNode(lua_State * vm) {
+        lua_Integer i, j, k; auto chunk = checkChunk(vm, 1, i, j, k);
+
+        lua_pushinteger(vm, chunk->get(i, j, k).id);
+        return 1;
+    }
+
     static int background(lua_State * vm) {
         using namespace Game;
 
@@ -160,11 +263,19 @@ namespace API {
 }
 
 static const luaL_Reg externs[] = {
-    {"register",   API::attach},
-    {"override",   API::override},
-    {"setHotbar",  API::setHotbar},
-    {"background", API::background},
-    {NULL,         NULL}
+    {"register",      API::attach},
+    {"override",      API::override},
+    {"setHotbar",     API::setHotbar},
+    {"background",    API::background},
+    {"backup",        API::backup},
+    {"census",        API::census},
+    {"storage",       API::storage},
+    {"saveSchematic", API::saveSchematic},
+    {"loadSchematic", API::loadSchematic},
+    {"generator",     API::generator},
+    {"setNode",       API::setNode},
+    {"getNode",       API::getNode},
+    {NULL,            NULL}
 };
 
 void LuaJIT::loadapi() {
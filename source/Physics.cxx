@@ -54,6 +54,9 @@ bool Entity::stuck(Chunk * C, Rank x, Real y, Rank z) {
 
     auto y₁ = std::floor(y), y₂ = std::floor(y + height);
 
+    // Column is known to be air over the whole height of the entity.
+    if (x < Fundamentals::chunkSize && z < Fundamentals::chunkSize && C->summary().clear(x, y₁, y₂, z)) return false;
+
     for (int L = y₁; L <= y₂; L++)
         if (!C->walkable(x, L, z))
             return true;
@@ -65,7 +68,12 @@ bool Entity::stuck() { return stuck(_chunk, _i, _camera.climb, _j); }
 
 bool Entity::moveHorizontally(const Gyrovector<Real> & v, const Real dt) {
     auto [P, chunkChanged] = _camera.position.move(v.scale(dt));
-    auto C = chunkChanged ? atlas()->poll(_camera.position.action(), P.action()) : chunk();
+    auto C = chunk();
+
+    if (chunkChanged) {
+        auto N = C != nullptr ? C->neighbour(P.center()) : nullptr;
+        C = N != nullptr ? N : atlas()->poll(_camera.position.action(), P.action());
+    }
 
     if (C != nullptr) {
         if (!C->ready()) return false;
@@ -0,0 +1,192 @@
+#include <unordered_set>
+#include <cstring>
+#include <cstdio>
+#include <cerrno>
+
+#include <Hyper/Schematic.hxx>
+
+using namespace Tesselation;
+
+// Quarter-turn about chunk’s center maps translation in each direction to translation in the next one.
+constexpr Direction cycle[] = {Up, Right, Down, Left};
+
+inline Direction turn(Direction d, size_t quarters) {
+    for (size_t k = 0; k < 4; k++)
+        if (cycle[k] == d) return cycle[(k + quarters) % 4];
+
+    return d;
+}
+
+inline Fuchsian<Integer> place(const Fuchsian<Integer> & G, const std::vector<Direction> & word) {
+    auto retval = G;
+
+    for (auto d : word) switch (d) {
+        case Up:    retval *= Tesselation::U; break;
+        case Down:  retval *= Tesselation::D; break;
+        case Left:  retval *= Tesselation::L; break;
+        case Right: retval *= Tesselation::R; break;
+        default:    break;
+    }
+
+    return retval;
+}
+
+// Such k that G = P × (z ↦ iᵏz), i.e. P⁻¹ × G is diagonal and the ratio of its entries is iᵏ.
+inline uint8_t quarter(const Fuchsian<Integer> & P, const Fuchsian<Integer> & G) {
+    auto M = P.inverse() * G; auto u = M.d;
+
+    for (uint8_t k = 0; k < 4; k++, u = u * ℤi(0, 1))
+        if (M.a == u) return k;
+
+    return 0; // should never happen, since both map the fundamental domain onto the same chunk
+}
+
+size_t Schematic::copy(Atlas & atlas, const Chunk * origin, size_t radius) {
+    entries.clear(); turns = 0;
+
+    std::unordered_set<Address, AddressHash> visited{Address()};
+    std::vector<Address> level{Address()};
+
+    for (size_t step = 0; step <= radius && !level.empty(); step++) {
+        std::vector<Address> next;
+
+        for (const auto & A : level) {
+            std::vector<Direction> word(A.length());
+            for (size_t i = 0; i < A.length(); i++) word[i] = A[i];
+
+            auto P = place(origin->isometry(), word);
+            const Chunk * C = atlas.lookup(P.origin());
+
+            if (C != nullptr && C->ready() && C->blob() != nullptr)
+                entries.push_back({word, quarter(P, C->isometry()), Encoding::encode(*C->blob())});
+
+            for (auto d : cycle) {
+                auto B = A * d;
+                if (visited.insert(B).second) next.push_back(B);
+            }
+        }
+
+        level = std::move(next);
+    }
+
+    return entries.size();
+}
+
+std::vector<Chunk *> Schematic::paste(Atlas & atlas, const Fuchsian<Integer> & origin, const Chunk * target) const {
+    std::vector<Chunk *> retval;
+
+    for (const auto & E : entries) {
+        std::vector<Direction> word(E.word.size());
+        for (size_t i = 0; i < word.size(); i++) word[i] = turn(E.word[i], turns);
+
+        auto P = place(target->isometry(), word);
+        auto C = atlas.poll(origin, P);
+
+        // Waits for loading as well as for meshing, which reads the blob.
+        C->join(); if (!C->ready()) continue;
+
+        auto blob = C->blob();
+        if (!Encoding::decode(*blob, E.data.data(), E.data.size())) continue;
+
+        // Counterclockwise quarter-turns (z ↦ iz) of the chunk, while `Blob::rotate` turns clockwise.
+        size_t k = (turns + E.turn + 4 - quarter(P, C->isometry())) % 4;
+        blob->rotate(4 - k);
+
+        C->markDirty(); C->requestRefresh(); retval.push_back(C);
+    }
+
+    return retval;
+}
+
+size_t Schematic::bytes() const {
+    size_t retval = 0;
+
+    for (const auto & E : entries)
+        retval += E.data.size();
+
+    return retval;
+}
+
+/*
+    File layout (all integers are little-endian):
+        u8 version, u8 number of quarter-turns, u32 number of chunks;
+        then for each chunk: u8 turn, u16 length of the word, u8 letters[length] (see `Tesselation::Direction`),
+                             u32 size, u8 data[size] (see `Encoding`).
+*/
+bool Schematic::save(const std::string & filename) const {
+    std::vector<uint8_t> buf;
+
+    auto put = [&buf](uint64_t x, size_t n) { for (size_t i = 0; i < n; i++) buf.push_back((x >> (8 * i)) & 0xFF); };
+
+    put(version, 1); put(turns, 1); put(entries.size(), 4);
+
+    for (const auto & E : entries) {
+        put(E.turn, 1); put(E.word.size(), 2);
+        for (auto d : E.word) put(uint8_t(d), 1);
+
+        put(E.data.size(), 4); buf.insert(buf.end(), E.data.begin(), E.data.end());
+    }
+
+    auto fd = std::fopen(filename.c_str(), "wb");
+
+    if (fd == nullptr || std::fwrite(buf.data(), 1, buf.size(), fd) != buf.size()) {
+        fprintf(stderr, "Unable to write “%s”: %s\n", filename.c_str(), std::strerror(errno));
+
+        if (fd != nullptr) std::fclose(fd);
+        return false;
+    }
+
+    return std::fclose(fd) == 0;
+}
+
+bool Schematic::load(const std::string & filename) {
+    std::vector<uint8_t> buf;
+
+    auto fd = std::fopen(filename.c_str(), "rb");
+
+    if (fd != nullptr && std::fseek(fd, 0, SEEK_END) == 0) {
+        auto size = std::ftell(fd); std::rewind(fd);
+        if (size >= 0) { buf.resize(size); if (std::fread(buf.data(), 1, size, fd) != size_t(size)) buf.clear(); }
+    }
+
+    if (fd == nullptr) { fprintf(stderr, "Unable to read “%s”: %s\n", filename.c_str(), std::strerror(errno)); return false; }
+    std::fclose(fd);
+
+    size_t offset = 0;
+
+    auto get = [&](uint64_t & x, size_t n) {
+        if (buf.size() - offset < n) return false;
+
+        x = 0; for (size_t i = 0; i < n; i++) x |= uint64_t(buf[offset++]) << (8 * i);
+        return true;
+    };
+
+    auto corrupt = [&]() { fprintf(stderr, "Schematic “%s” is corrupt\n", filename.c_str()); return false; };
+
+    uint64_t v, t, count; if (!get(v, 1) || v != version || !get(t, 1) || t >= 4 || !get(count, 4)) return corrupt();
+
+    std::vector<Entry> retval; Blob blob;
+
+    for (size_t n = 0; n < count; n++) {
+        Entry E; uint64_t quarters, length, size;
+
+        if (!get(quarters, 1) || quarters >= 4 || !get(length, 2)) return corrupt();
+        E.turn = quarters; E.word.resize(length);
+
+        for (auto & d : E.word) {
+            uint64_t x; if (!get(x, 1) || x < uint64_t(Up) || x > uint64_t(Right)) return corrupt();
+            d = Direction(x);
+        }
+
+        if (!get(size, 4) || buf.size() - offset < size) return corrupt();
+
+        E.data.assign(buf.begin() + offset, buf.begin() + offset + size); offset += size;
+        if (!Encoding::decode(blob, E.data.data(), E.data.size())) return corrupt();
+
+        retval.push_back(std::move(E));
+    }
+
+    if (offset != buf.size()) return corrupt();
+
+    entries = std::move(retval); turns = t; return true;
+}
@@ -0,0 +1,1493 @@
+#include <unordered_map>
+#include <algorithm>
+#include <bit>
+#include <cstring>
+#include <cstdio>
+
+#ifndef _WIN32
+    #include <sys/mman.h>
+    #include <sys/stat.h>
+    #include <fcntl.h>
+    #include <unistd.h>
+#endif
+
+#include <Hyper/Storage.hxx>
+
+namespace Encoding {
+    /*
+        Version 1 layout (all integers are little-endian):
+            u8  version;
+            u16 n, size of the palette;
+            u16 palette[n], `NodeId`s occurring in the chunk;
+            then runs of equal nodes in [i][j][k] order (see `Blob`) until the whole chunk (or section) is covered:
+                varint (LEB128) length of the run minus one,
+                u8 (if n ≤ 256) or u16 (otherwise) index into the palette.
+
+        Typical chunk is mostly air, so it takes dozens of bytes instead of 2 bytes per node.
+        If encoded data happens to be not shorter than raw one, raw nodes are stored instead;
+        so any record of exactly raw size (of chunk or section) is raw (this is also how legacy rows look like).
+    */
+    using namespace Fundamentals;
+
+    /*
+        Nodes of either the whole chunk or one its section, enumerated in [i][j][k] order.
+        They go in stripes of `stripe` consecutive nodes of one `Section`,
+        stripes run over `count` sections starting from `first`, then the same for the next i.
+    */
+    struct Range {
+        size_t volume, stripe, count, first;
+
+        // n-th node of the range is `index`-th node of section `s`
+        inline std::pair<size_t, size_t> locate(size_t n) const {
+            auto t = n / stripe;
+            return {first + t % count, t / count * stripe + n % stripe};
+        }
+
+        inline NodeId get(const Blob & blob, size_t n) const {
+            auto [s, index] = locate(n); auto section = blob.section(s);
+            return section == nullptr ? 0 : section->get(index);
+        }
+
+        // End of the run of nodes equal to n-th one, missing sections are skipped at once.
+        inline size_t run(const Blob & blob, size_t n) const {
+            auto id = get(blob, n);
+
+            while (n < volume) {
+                if (id == 0 && blob.empty(locate(n).first)) { n = (n / stripe + 1) * stripe; continue; }
+                if (get(blob, n) != id) break; n++;
+            }
+
+            return n;
+        }
+
+        // Sets nodes n, n + 1, ..., m - 1, stripe by stripe. Range is supposed to be cleared, so air is skipped.
+        inline void fill(Blob & blob, size_t n, size_t m, NodeId id) const {
+            if (id == 0) return;
+
+            while (n < m) {
+                auto [s, index] = locate(n); auto end = std::min(m, (n / stripe + 1) * stripe);
+                blob.allocate(s)->fill(index, index + (end - n), id); n = end;
+            }
+        }
+
+        inline void clear(Blob & blob) const {
+            for (auto s = first; s < first + count; s++)
+                blob.clear(s);
+        }
+
+        inline size_t size() const { return volume * sizeof(Node); }
+    };
+
+    constexpr Range chunk { chunkSize * worldHeight * chunkSize, sectionHeight * chunkSize, sectionCount, 0 };
+
+    constexpr Range section(size_t s)
+    { return { chunkSize * sectionHeight * chunkSize, chunkSize * sectionHeight * chunkSize, 1, s }; }
+
+    inline void putWord(std::vector<uint8_t> & buf, uint16_t x)
+    { buf.push_back(x & 0xFF); buf.push_back(x >> 8); }
+
+    inline void putVarint(std::vector<uint8_t> & buf, size_t x) {
+        for (; x >= 0x80; x >>= 7) buf.push_back((x & 0x7F) | 0x80);
+        buf.push_back(x);
+    }
+
+    std::vector<uint8_t> encode(const Blob & blob, const Range & range) {
+        std::vector<NodeId> palette; std::unordered_map<NodeId, uint16_t> index;
+        std::vector<std::pair<size_t, uint16_t>> runs;
+
+        for (size_t n = 0; n < range.volume;) {
+            auto id = range.get(blob, n); auto m = range.run(blob, n);
+
+            auto [it, fresh] = index.try_emplace(id, palette.size());
+            if (fresh) palette.push_back(id);
+
+            runs.emplace_back(m - n, it->second); n = m;
+        }
+
+        std::vector<uint8_t> retval; retval.reserve(3 + 2 * palette.size() + 3 * runs.size());
+
+        retval.push_back(version);
+        putWord(retval, palette.size());
+
+        for (auto id : palette)
+            putWord(retval, id);
+
+        bool wide = palette.size() > 256;
+
+        for (auto [length, idx] : runs) {
+            putVarint(retval, length - 1);
+            if (wide) putWord(retval, idx); else retval.push_back(idx);
+        }
+
+        if (retval.size() >= range.size()) {
+            retval.resize(range.size());
+
+            for (size_t n = 0; n < range.volume; n++) {
+                auto id = range.get(blob, n);
+                memcpy(retval.data() + n * sizeof(Node), &id, sizeof(NodeId));
+            }
+        }
+
+        return retval;
+    }
+
+    bool decode(Blob & blob, const Range & range, const void * data, size_t size) {
+        if (data == nullptr) return false;
+
+        auto buf = static_cast<const uint8_t *>(data), end = buf + size;
+
+        range.clear(blob);
+
+        if (size == range.size()) {
+            for (size_t n = 0; n < range.volume; n++) {
+                NodeId id; memcpy(&id, buf + n * sizeof(Node), sizeof(NodeId));
+                range.fill(blob, n, n + 1, id);
+            }
+
+            return true;
+        }
+
+        auto getByte = [&](size_t & x) { if (buf >= end) return false; x = *buf++; return true; };
+        auto getWord = [&](size_t & x) { if (end - buf < 2) return false; x = buf[0] | (buf[1] << 8); buf += 2; return true; };
+
+        auto getVarint = [&](size_t & x) {
+            x = 0;
+
+            for (size_t shift = 0; shift < 8 * sizeof(size_t); shift += 7) {
+                if (buf >= end) return false;
+
+                auto byte = *buf++; x |= size_t(byte & 0x7F) << shift;
+                if (!(byte & 0x80)) return true;
+            }
+
+            return false;
+        };
+
+        size_t v, n; if (!getByte(v) || v != version || !getWord(n) || n == 0) return false;
+
+        std::vector<NodeId> palette(n);
+        for (auto & id : palette) { size_t x; if (!getWord(x)) return false; id = x; }
+
+        bool wide = n > 256;
+
+        for (size_t k = 0; k < range.volume;) {
+            size_t length, idx;
+
+            if (!getVarint(length) || !(wide ? getWord(idx) : getByte(idx))) return false;
+            if (idx >= n || range.volume - k <= length) return false;
+
+            range.fill(blob, k, k + length + 1, palette[idx]); k += length + 1;
+        }
+
+        return buf == end;
+    }
+
+    std::vector<uint8_t> encode(const Blob & blob) { return encode(blob, chunk); }
+    std::vector<uint8_t> encode(const Blob & blob, size_t s) { return encode(blob, section(s)); }
+
+    bool decode(Blob & blob, const void * data, size_t size) { return decode(blob, chunk, data, size); }
+    bool decode(Blob & blob, size_t s, const void * data, size_t size) { return decode(blob, section(s), data, size); }
+
+    /*
+        Each of four integers of the position (`first.real`, `first.imag`, `second.real`, `second.imag`)
+        is written as varint (2 × n + sign) followed by n big-endian bytes of its absolute value.
+        Since `Fuchsian::origin` is normalized, equal positions always give equal keys.
+    */
+    void putInteger(std::string & buf, const Integer & x) {
+        uint64_t m = x.fits() ? std::abs(x.word()) : 0;
+
+        auto n = x.fits() ? (std::bit_width(m) + 7) / 8 : (mpz_sizeinbase(x.mpz().get_mpz_t(), 2) + 7) / 8;
+
+        for (auto k = 2 * n + Math::isNeg(x); ; k >>= 7) {
+            if (k < 0x80) { buf.push_back(char(k)); break; }
+            buf.push_back(char((k & 0x7F) | 0x80));
+        }
+
+        if (x.fits()) for (auto i = n; i > 0; i--) buf.push_back(char(m >> (8 * (i - 1))));
+        else { auto offset = buf.size(); buf.resize(offset + n); mpz_export(buf.data() + offset, nullptr, 1, 1, 0, 0, x.mpz().get_mpz_t()); }
+    }
+
+    std::string key(const Gaussian²<Integer> & pos) {
+        std::string retval;
+
+        putInteger(retval, pos.first.real);
+        putInteger(retval, pos.first.imag);
+        putInteger(retval, pos.second.real);
+        putInteger(retval, pos.second.imag);
+
+        return retval;
+    }
+
+    // https://en.wikipedia.org/wiki/Fowler%E2%80%93Noll%E2%80%93Vo_hash_function (FNV-1a)
+    int64_t hash(const void * data, size_t size) {
+        uint64_t retval = 0xCBF29CE484222325; auto bytes = static_cast<const uint8_t *>(data);
+
+        for (size_t i = 0; i < size; i++) { retval ^= bytes[i]; retval *= 0x100000001B3; }
+
+        return int64_t(retval);
+    }
+
+    int64_t hash(const std::string & key) { return hash(key.data(), key.size()); }
+}
+
+// Width of palette indices enough for n different nodes, 16 means no palette.
+inline uint8_t width(size_t n) {
+    for (uint8_t bits : {0, 1, 2, 4, 8})
+        if (n <= (size_t(1) << bits)) return bits;
+
+    return 16;
+}
+
+// Rebuilds the section from given nodes, leaving room for `spare` more kinds of nodes.
+void Section::assign(const std::vector<NodeId> & ids, size_t spare) {
+    std::unordered_map<NodeId, size_t> index; palette.clear();
+
+    for (auto id : ids)
+        if (index.try_emplace(id, palette.size()).second) palette.push_back(id);
+
+    bits = width(palette.size() + spare); words.assign(volume * bits / 64, 0);
+
+    if (bits == 16) palette.clear();
+
+    if (bits > 0) for (size_t n = 0; n < volume; n++)
+        put(n, palette.empty() ? ids[n] : index[ids[n]]);
+}
+
+size_t Section::lookup(NodeId id) {
+    if (palette.empty()) return id;
+
+    for (size_t idx = 0; idx < palette.size(); idx++)
+        if (palette[idx] == id) return idx;
+
+    if (palette.size() >= (size_t(1) << bits)) {
+        std::vector<NodeId> ids(volume);
+
+        for (size_t n = 0; n < volume; n++)
+            ids[n] = get(n);
+
+        assign(ids, 1); if (palette.empty()) return id;
+    }
+
+    palette.push_back(id); return palette.size() - 1;
+}
+
+void Section::fill(size_t n, size_t m, NodeId id) {
+    auto idx = lookup(id); if (bits == 0) return;
+
+    for (; n < m; n++) put(n, idx);
+}
+
+// Walks through the words once instead of locating every index separately (as `get` does).
+void Section::unpack(NodeId * retval) const {
+    if (bits == 0) { std::fill(retval, retval + volume, palette[0]); return; }
+
+    const uint64_t mask = (uint64_t(1) << bits) - 1; const size_t count = 64 / bits;
+
+    if (palette.empty()) {
+        for (auto word : words)
+            for (size_t m = 0; m < count; m++, word >>= bits)
+                *retval++ = NodeId(word & mask);
+
+        return;
+    }
+
+    const auto * ids = palette.data();
+
+    for (auto word : words)
+        for (size_t m = 0; m < count; m++, word >>= bits)
+            *retval++ = ids[word & mask];
+}
+
+// Palette stays the same, only its indices are moved: they are unpacked first, then written back in storage order.
+void Section::rotate(size_t quarters) {
+    using namespace Fundamentals; constexpr size_t N = chunkSize;
+
+    quarters %= 4; if (quarters == 0 || bits == 0) return;
+
+    std::vector<uint16_t> indices(volume);
+    for (size_t n = 0; n < volume; n++) indices[n] = index(n);
+
+    // Node that comes to (i, k)
+    auto from = [quarters](size_t i, size_t k) -> std::pair<size_t, size_t> {
+        switch (quarters) {
+            case 1:  return {k, N - 1 - i};
+            case 2:  return {N - 1 - i, N - 1 - k};
+            default: return {N - 1 - k, i};
+        }
+    };
+
+    for (size_t i = 0; i < N; i++) for (size_t j = 0; j < sectionHeight; j++) for (size_t k = 0; k < N; k++) {
+        auto [i₀, k₀] = from(i, k);
+        put(at(i, j, k), indices[at(i₀, j, k₀)]);
+    }
+}
+
+bool Section::operator==(const Section & section) const {
+    if (bits == section.bits && palette == section.palette) return words == section.words;
+
+    for (size_t n = 0; n < volume; n++)
+        if (get(n) != section.get(n)) return false;
+
+    return true;
+}
+
+// Depends only on nodes, not on the palette.
+int64_t Section::digest() const {
+    uint64_t retval = 0xCBF29CE484222325;
+
+    for (size_t n = 0; n < volume; n++)
+    { retval ^= get(n); retval *= 0x100000001B3; }
+
+    return int64_t(retval);
+}
+
+Blob::Blob(const Blob & blob) { *this = blob; }
+
+Blob::Blob(Blob && blob) { *this = std::move(blob); }
+
+Blob::~Blob() { clear(); }
+
+Blob & Blob::operator=(const Blob & blob) {
+    if (this == &blob) return *this;
+
+    for (size_t s = 0; s < Fundamentals::sectionCount; s++) {
+        if (blob.sections[s] == nullptr) clear(s);
+        else *allocate(s) = *blob.sections[s];
+    }
+
+    return *this;
+}
+
+Blob & Blob::operator=(Blob && blob) {
+    for (size_t s = 0; s < Fundamentals::sectionCount; s++)
+        std::swap(sections[s], blob.sections[s]);
+
+    return *this;
+}
+
+bool Blob::operator==(const Blob & blob) const {
+    for (size_t s = 0; s < Fundamentals::sectionCount; s++) {
+        if (empty(s) != blob.empty(s)) return false;
+        if (!empty(s) && !(*sections[s] == *blob.sections[s])) return false;
+    }
+
+    return true;
+}
+
+Section * Blob::allocate(size_t s) {
+    if (sections[s] == nullptr) sections[s] = new Section();
+    return sections[s];
+}
+
+void Blob::clear(size_t s) { delete sections[s]; sections[s] = nullptr; }
+
+void Blob::clear() {
+    for (size_t s = 0; s < Fundamentals::sectionCount; s++)
+        clear(s);
+}
+
+void Blob::rotate(size_t quarters) {
+    for (auto section : sections)
+        if (section != nullptr) section->rotate(quarters);
+}
+
+int64_t Blob::digest() const {
+    uint64_t retval = 0xCBF29CE484222325;
+
+    for (size_t s = 0; s < Fundamentals::sectionCount; s++)
+        if (!empty(s)) retval = (retval ^ s ^ uint64_t(sections[s]->digest())) * 0x100000001B3;
+
+    return int64_t(retval);
+}
+
+void Summary::clear() {
+    for (auto & row : _bottom) row.fill(Fundamentals::worldTop);
+    for (auto & row : _top) row.fill(0);
+
+    _occupancy.fill(0);
+}
+
+void Summary::build(const Blob & blob) {
+    using namespace Fundamentals;
+
+    clear();
+
+    for (size_t s = 0; s < sectionCount; s++) {
+        auto section = blob.section(s);
+        if (section == nullptr) continue;
+
+        for (size_t n = 0; n < Section::volume; n++) {
+            if (section->get(n) == 0) continue;
+
+            auto i = n / (sectionHeight * chunkSize), k = n % chunkSize;
+            auto j = Level(s * sectionHeight + n / chunkSize % sectionHeight);
+
+            _occupancy[s]++;
+            _bottom[i][k] = std::min(_bottom[i][k], j);
+            _top[i][k]    = std::max(_top[i][k], j);
+        }
+    }
+}
+
+void Summary::rescan(const Blob & blob, size_t i, size_t k) {
+    using namespace Fundamentals;
+
+    _bottom[i][k] = worldTop; _top[i][k] = 0;
+
+    for (int j = 0; j <= worldTop; j++) {
+        if (_occupancy[j / sectionHeight] == 0) { j += sectionHeight - 1 - j % sectionHeight; continue; }
+        if (blob.get(i, j, k).id != 0) { _bottom[i][k] = Level(j); break; }
+    }
+
+    for (int j = worldTop; j >= 0; j--) {
+        if (_occupancy[j / sectionHeight] == 0) { j -= j % sectionHeight; continue; }
+        if (blob.get(i, j, k).id != 0) { _top[i][k] = Level(j); break; }
+    }
+}
+
+void Summary::update(const Blob & blob, size_t i, size_t j, size_t k, NodeId before, NodeId after) {
+    if ((before == 0) == (after == 0)) return;
+
+    auto & count = _occupancy[j / Fundamentals::sectionHeight];
+
+    if (after != 0) {
+        count++;
+        _bottom[i][k] = std::min<Level>(_bottom[i][k], j);
+        _top[i][k]    = std::max<Level>(_top[i][k], j);
+    } else {
+        count--;
+        // Removing a node from inside of the column leaves its range as it is.
+        if (j == _bottom[i][k] || j == _top[i][k]) rescan(blob, i, k);
+    }
+}
+
+inline void decode(Blob & blob, const void * data, size_t size) {
+    if (!Encoding::decode(blob, data, size)) {
+        std::fprintf(stderr, "Unable to decode chunk (%zu bytes)\n", size);
+        blob.clear();
+    }
+}
+
+inline void decode(Blob & blob, size_t section, const void * data, size_t size) {
+    if (!Encoding::decode(blob, section, data, size)) {
+        std::fprintf(stderr, "Unable to decode section %zu (%zu bytes)\n", section, size);
+        blob.clear(section);
+    }
+}
+
+void ChunkStore::start()
+{ running = true; thread = std::thread(&ChunkStore::loop, this); }
+
+void ChunkStore::stop() {
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        running = false;
+    }
+
+    cv.notify_one();
+    if (thread.joinable()) thread.join();
+}
+
+void ChunkStore::push(const Gaussian²<Integer> & pos, const Blob & blob, Sections sections)
+{ if (sections != 0) staged.push_back({pos, new Blob(blob), sections}); }
+
+void ChunkStore::submit() {
+    if (staged.empty()) return;
+
+    _depth += staged.size();
+
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        queue.insert(queue.end(), staged.begin(), staged.end());
+    }
+
+    staged.clear(); cv.notify_one();
+}
+
+const auto stepPause  = std::chrono::milliseconds(5);    // between steps of the background work
+const auto retryPause = std::chrono::milliseconds(1000); // before writing a failed batch again
+
+void ChunkStore::loop() {
+    bool work, failed = false;
+
+    for (;;) {
+        {
+            std::unique_lock<std::mutex> lock(mutex);
+            auto ready = [this]() { return !queue.empty() || !running; };
+
+            // Idle thread is also woken by `resume`; while stepping, it only pauses between steps.
+            if (failed) cv.wait_for(lock, retryPause, [this]() { return !running; });
+            else if (stepping) cv.wait_for(lock, stepPause, ready);
+            else cv.wait(lock, [&]() { return ready() || stepping; });
+
+            if (queue.empty() && !running) return;
+
+            // Jobs stay in `flushing` until they are written, so that `load` still finds them.
+            std::swap(flushing, queue); work = stepping;
+        }
+
+        failed = false;
+
+        if (!flushing.empty()) {
+            auto t₀ = std::chrono::steady_clock::now();
+
+            if (flush(flushing)) {
+                std::chrono::duration<double> Δt = std::chrono::steady_clock::now() - t₀;
+                _latency = Δt.count(); _flushes++;
+            } else failed = true;
+
+            std::lock_guard<std::mutex> lock(mutex);
+
+            if (failed && running) {
+                // Older jobs go first, so that newer saves of the same chunk still win.
+                flushing.insert(flushing.end(), queue.begin(), queue.end());
+                std::swap(flushing, queue);
+            } else {
+                if (failed) std::fprintf(stderr, "Unable to save %zu chunks\n", flushing.size());
+
+                for (auto & job : flushing)
+                    delete job.blob;
+
+                _depth -= flushing.size();
+            }
+
+            flushing.clear();
+        }
+
+        if (work && !step()) {
+            std::lock_guard<std::mutex> lock(mutex);
+            stepping = false;
+        }
+    }
+}
+
+bool ChunkStore::load(const Gaussian²<Integer> & pos, Blob & blob, Sections & stale) {
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+
+        // Jobs in `queue` are newer than those in `flushing`, and later jobs are newer within each.
+        for (auto jobs : {&queue, &flushing})
+            for (auto it = jobs->rbegin(); it != jobs->rend(); it++)
+                if (it->pos == pos) { blob = *it->blob; return true; }
+    }
+
+    return read(pos, blob, stale);
+}
+
+bool ChunkStore::resume() {
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+
+        if (stepping) return false;
+        stepping = true;
+    }
+
+    cv.notify_one(); return true;
+}
+
+bool ChunkStore::busy() {
+    std::lock_guard<std::mutex> lock(mutex);
+    return stepping;
+}
+
+ChunkStore * ChunkStore::open(const std::string & kind, const std::string & filename) {
+    if (kind == "sqlite") return new SQLiteStore(filename);
+
+    #ifndef _WIN32
+    if (kind == "region") return new RegionStore(filename);
+    #else
+    if (kind == "region") throw std::runtime_error("region storage is not supported on this platform");
+    #endif
+
+    throw std::runtime_error("unknown storage “" + kind + "”");
+}
+
+using Stored = std::pair<const void *, size_t>[Fundamentals::sectionCount];
+
+// What `maintain` does with sections of one chunk: `rewrite` are stored again with `data`, `erase` are deleted.
+struct Verdict { Sections rewrite = 0, erase = 0; std::vector<uint8_t> data[Fundamentals::sectionCount]; };
+
+Verdict examine(const Stored & stored, Sections present, ChunkStore::Report & report) {
+    static const auto air = Encoding::encode(Blob(), 0);
+
+    Verdict retval; auto blob = new Blob(); bool empty = true;
+
+    for (size_t section = 0; section < Fundamentals::sectionCount; section++) {
+        if (!Bitfield<Sections>(present).get(section)) continue;
+
+        auto [data, size] = stored[section]; report.sections++;
+        if (!Encoding::decode(*blob, section, data, size)) { report.corrupt++; empty = false; continue; }
+
+        auto fresh = Encoding::encode(*blob, section);
+        if (fresh == air) { retval.erase |= Sections(1) << section; continue; }
+
+        empty = false;
+
+        if (fresh.size() != size || memcmp(fresh.data(), data, size) != 0) {
+            retval.rewrite |= Sections(1) << section; report.reencoded++;
+            retval.data[section] = std::move(fresh);
+        }
+    }
+
+    delete blob; report.chunks++;
+    if (empty) report.dropped++; else report.cleared += std::popcount(retval.erase);
+
+    return retval;
+}
+
+/*
+    Chunks are keyed by canonical encoding of their position (see `Encoding::key`),
+    lookups go through 64-bit hash of this key, which is indexed as plain INTEGER.
+    Every section of the chunk is a separate row, so that saving touches only modified ones.
+
+    Sections of at least `sharedPayload` bytes are stored once in `payloads` under `Encoding::hash` of the data
+    and referred to by `sections.payload` (`sections.blob` is NULL then); smaller ones are stored inline.
+    Payloads that are no longer referred to are deleted by `maintain`.
+
+    Worlds created before that used either `chunks` table with one row per chunk
+    or `atlas` table with five-column key; they are migrated on open.
+*/
+const char * initcmd    = "CREATE TABLE IF NOT EXISTS sections(pos BLOB NOT NULL, section INTEGER NOT NULL, hash INTEGER NOT NULL, blob BLOB, payload INTEGER, PRIMARY KEY (pos, section));"
+                          "CREATE INDEX IF NOT EXISTS sections_hash ON sections(hash);"
+                          "CREATE TABLE IF NOT EXISTS payloads(digest INTEGER PRIMARY KEY, data BLOB NOT NULL);",
+           * loadcmd    = "SELECT section, coalesce(blob, data) FROM sections INDEXED BY sections_hash "
+                          "LEFT JOIN payloads ON digest = payload WHERE hash = ? AND pos = ?;",
+           * insertcmd  = "INSERT or REPLACE INTO sections(hash, pos, section, blob, payload) VALUES(?, ?, ?, ?, ?);",
+           * sharecmd   = "INSERT or IGNORE INTO payloads(digest, data) VALUES(?, ?);",
+           * checkcmd   = "SELECT data = ? FROM payloads WHERE digest = ?;",
+           * legacycmd  = "SELECT name FROM sqlite_master WHERE type = 'table' AND name = ?;",
+           * columncmd  = "SELECT count(*) FROM pragma_table_info('sections') WHERE name = 'payload';",
+           * altercmd    = "ALTER TABLE sections ADD COLUMN payload INTEGER;",
+           * atlascmd   = "SELECT bitfield, real1, imag1, real2, imag2, blob FROM atlas;",
+           * chunkscmd  = "SELECT hash, pos, blob FROM chunks;";
+
+const char * keyscmd     = "SELECT DISTINCT hash, pos FROM sections;",
+           * sectionscmd = "SELECT section, coalesce(blob, data), payload IS NULL FROM sections INDEXED BY sections_hash "
+                           "LEFT JOIN payloads ON digest = payload WHERE hash = ? AND pos = ?;",
+           * deletecmd   = "DELETE FROM sections WHERE hash = ? AND pos = ? AND section = ?;",
+           * orphanscmd  = "DELETE FROM payloads WHERE digest NOT IN (SELECT payload FROM sections WHERE payload IS NOT NULL);";
+
+const size_t sharedPayload = 64; // bytes
+
+const char * walcmd = "PRAGMA journal_mode = WAL;";
+
+const int busyTimeout = 5000; // ms
+const size_t readersCount = 4;
+
+inline void warn(sqlite3 * engine)
+{ std::fprintf(stderr, "SQLITE: %s\n", sqlite3_errmsg(engine)); }
+
+int64_t pragma(sqlite3 * engine, const char * cmd) {
+    sqlite3_stmt * statement = nullptr; int64_t retval = 0;
+
+    if (sqlite3_prepare_v2(engine, cmd, -1, &statement, nullptr) == SQLITE_OK && sqlite3_step(statement) == SQLITE_ROW)
+        retval = sqlite3_column_int64(statement, 0);
+
+    sqlite3_finalize(statement); return retval;
+}
+
+inline size_t size(sqlite3 * engine)
+{ return pragma(engine, "PRAGMA page_count;") * pragma(engine, "PRAGMA page_size;"); }
+
+void SQLiteStore::serialize(sqlite3_stmt * statement, const Gaussian²<Integer> & pos, int idx₀, int idx₁) {
+    auto key = Encoding::key(pos);
+
+    sqlite3_bind_int64(statement, idx₀, Encoding::hash(key));
+    sqlite3_bind_blob(statement, idx₁, key.data(), key.size(), SQLITE_TRANSIENT);
+}
+
+Integer loadInteger(sqlite3_stmt * statement, int index, bool negative) {
+    mpz_class retval;
+
+    auto data = sqlite3_column_blob(statement, index);
+    auto size = sqlite3_column_bytes(statement, index);
+
+    if (data != nullptr) mpz_import(retval.get_mpz_t(), size, 1, 1, 0, 0, data);
+    if (negative) retval = -retval;
+
+    return Integer(std::move(retval));
+}
+
+// Stores one section, either inline or as a reference to the shared payload.
+bool SQLiteStore::write(int64_t hash, const std::string & key, size_t section, const std::vector<uint8_t> & data) {
+    sqlite3_bind_int64(insert, 1, hash);
+    sqlite3_bind_blob(insert, 2, key.data(), key.size(), SQLITE_STATIC);
+    sqlite3_bind_int(insert, 3, section);
+
+    bool local = data.size() < sharedPayload;
+
+    if (!local) {
+        auto digest = Encoding::hash(data.data(), data.size());
+
+        sqlite3_bind_int64(share, 1, digest);
+        sqlite3_bind_blob(share, 2, data.data(), data.size(), SQLITE_STATIC);
+
+        auto retval = sqlite3_step(share); sqlite3_reset(share); sqlite3_clear_bindings(share);
+        if (retval != SQLITE_DONE) return false;
+
+        // Payload with this digest already exists, but it may be a different one.
+        if (sqlite3_changes(engine) == 0) {
+            sqlite3_bind_blob(check, 1, data.data(), data.size(), SQLITE_STATIC);
+            sqlite3_bind_int64(check, 2, digest);
+
+            local = sqlite3_step(check) != SQLITE_ROW || sqlite3_column_int(check, 0) == 0;
+            sqlite3_reset(check); sqlite3_clear_bindings(check);
+        }
+
+        if (!local) sqlite3_bind_int64(insert, 5, digest);
+    }
+
+    if (local) sqlite3_bind_blob(insert, 4, data.data(), data.size(), SQLITE_STATIC);
+
+    auto retval = sqlite3_step(insert);
+    sqlite3_reset(insert); sqlite3_clear_bindings(insert);
+
+    return retval == SQLITE_DONE;
+}
+
+/*
+    Moves chunks from the legacy `table` (if any) into `sections`. `cmd` selects whole chunks, its last column is the blob;
+    `locate` returns hash and key of the selected chunk.
+*/
+template<typename F> void SQLiteStore::migrate(const char * table, const char * cmd, F && locate) {
+    sqlite3_stmt * statement = nullptr;
+
+    if (sqlite3_prepare_v2(engine, legacycmd, -1, &statement, nullptr) != SQLITE_OK)
+        throw std::runtime_error("sqlite3 migration failed");
+
+    sqlite3_bind_text(statement, 1, table, -1, SQLITE_STATIC);
+    bool legacy = sqlite3_step(statement) == SQLITE_ROW; sqlite3_finalize(statement);
+    if (!legacy) return;
+
+    std::fprintf(stderr, "Migrating world from `%s` to the new chunk format...\n", table);
+
+    sqlite3_exec(engine, "BEGIN;", nullptr, 0, nullptr);
+
+    auto retval = sqlite3_prepare_v2(engine, cmd, -1, &statement, nullptr);
+
+    size_t count = 0; auto blob = new Blob(); auto column = sqlite3_column_count(statement) - 1;
+
+    while (retval == SQLITE_OK && sqlite3_step(statement) == SQLITE_ROW) {
+        decode(*blob, sqlite3_column_blob(statement, column), sqlite3_column_bytes(statement, column));
+        auto [hash, key] = locate(statement);
+
+        for (size_t section = 0; section < Fundamentals::sectionCount && retval == SQLITE_OK; section++)
+            if (!write(hash, key, section, Encoding::encode(*blob, section))) retval = SQLITE_ERROR;
+
+        count++;
+    }
+
+    delete blob; sqlite3_finalize(statement);
+
+    if (retval == SQLITE_OK) retval = sqlite3_exec(engine, ("DROP TABLE " + std::string(table) + "; COMMIT;").c_str(), nullptr, 0, nullptr);
+
+    if (retval != SQLITE_OK) {
+        warn(engine); sqlite3_exec(engine, "ROLLBACK;", nullptr, 0, nullptr);
+        throw std::runtime_error("sqlite3 migration failed");
+    }
+
+    std::fprintf(stderr, "Migrated %zu chunks\n", count);
+}
+
+void SQLiteStore::migrate() {
+    migrate("atlas", atlascmd, [](sqlite3_stmt * statement) {
+        Bitfield<uint8_t> bitfield(sqlite3_column_int(statement, 0));
+
+        Gaussian²<Integer> pos(
+            Gaussian<Integer>(loadInteger(statement, 1, bitfield.get(0)), loadInteger(statement, 2, bitfield.get(1))),
+            Gaussian<Integer>(loadInteger(statement, 3, bitfield.get(2)), loadInteger(statement, 4, bitfield.get(3)))
+        );
+
+        auto key = Encoding::key(pos); auto hash = Encoding::hash(key);
+        return std::pair(hash, key);
+    });
+
+    migrate("chunks", chunkscmd, [](sqlite3_stmt * statement) {
+        auto data = static_cast<const char *>(sqlite3_column_blob(statement, 1));
+        return std::pair(sqlite3_column_int64(statement, 0), std::string(data, sqlite3_column_bytes(statement, 1)));
+    });
+}
+
+void SQLiteStore::prepare(std::initializer_list<std::pair<const char *, sqlite3_stmt **>> statements) {
+    for (auto [cmd, statement] : statements)
+        if (sqlite3_prepare_v3(engine, cmd, -1, SQLITE_PREPARE_PERSISTENT, statement, nullptr) != SQLITE_OK)
+            { warn(engine); throw std::runtime_error("`sqlite3_prepare_v3` failed"); }
+}
+
+SQLiteStore::SQLiteStore(const std::string & filename) {
+    auto retval = sqlite3_open(filename.c_str(), &engine);
+
+    if (retval != SQLITE_OK) {
+        warn(engine); sqlite3_close(engine);
+        throw std::runtime_error("`sqlite3_open` failed");
+    }
+
+    // WAL lets readers proceed while the writer holds a transaction open.
+    char * errmsg; retval = sqlite3_exec(engine, walcmd, nullptr, 0, &errmsg);
+
+    if (retval == SQLITE_OK)
+        retval = sqlite3_exec(engine, initcmd, nullptr, 0, &errmsg);
+
+    if (retval != SQLITE_OK) {
+        std::fprintf(stderr, "SQLITE: %s\n", errmsg); sqlite3_free(errmsg);
+        sqlite3_close(engine);
+
+        throw std::runtime_error("sqlite3 initialization failed");
+    }
+
+    sqlite3_busy_timeout(engine, busyTimeout);
+
+    // In WAL mode this is still durable against application crashes, but skips fsync on every commit.
+    sqlite3_exec(engine, "PRAGMA synchronous = NORMAL;", nullptr, 0, nullptr);
+
+    try {
+        // Column may be missing until the migration, so `insert` is prepared after that.
+        prepare({std::pair(sharecmd, &share), std::pair(checkcmd, &check), std::pair("BEGIN;", &begin),
+                 std::pair("COMMIT;", &commit), std::pair("ROLLBACK;", &rollback)});
+
+        if (pragma(engine, columncmd) == 0 && sqlite3_exec(engine, altercmd, nullptr, 0, nullptr) != SQLITE_OK)
+            { warn(engine); throw std::runtime_error("sqlite3 migration failed"); }
+
+        prepare({std::pair(insertcmd, &insert)});
+
+        migrate();
+    } catch (...) {
+        for (auto statement : {insert, share, check, begin, commit, rollback})
+            sqlite3_finalize(statement);
+
+        sqlite3_close(engine); throw;
+    }
+
+    readers.open(filename, readersCount);
+
+    start();
+}
+
+SQLiteStore::~SQLiteStore() {
+    stop(); readers.close(); finish(false);
+
+    for (auto statement : {insert, share, check, begin, commit, rollback})
+        sqlite3_finalize(statement);
+
+    sqlite3_close(engine);
+}
+
+bool SQLiteStore::read(const Gaussian²<Integer> & pos, Blob & blob, Sections &) {
+    auto [engine, statement] = readers.acquire();
+
+    serialize(statement, pos, 1, 2);
+
+    int retval; bool found = false;
+
+    while ((retval = sqlite3_step(statement)) == SQLITE_ROW) {
+        auto section = sqlite3_column_int(statement, 0); found = true;
+
+        if (0 <= section && section < Fundamentals::sectionCount)
+            decode(blob, section, sqlite3_column_blob(statement, 1), sqlite3_column_bytes(statement, 1));
+    }
+
+    if (retval != SQLITE_DONE) warn(engine);
+
+    sqlite3_reset(statement); sqlite3_clear_bindings(statement);
+    readers.release({engine, statement});
+
+    // Chunk is (re)generated only if it’s surely absent, not on I/O errors.
+    return found || retval != SQLITE_DONE;
+}
+
+inline bool exec(sqlite3 * engine, sqlite3_stmt * statement) {
+    auto retval = sqlite3_step(statement); sqlite3_reset(statement);
+    if (retval != SQLITE_DONE) { warn(engine); return false; } else return true;
+}
+
+bool SQLiteStore::flush(std::vector<Job> & jobs) {
+    if (!exec(engine, begin)) return false;
+
+    for (auto & job : jobs) {
+        auto key = Encoding::key(job.pos); auto hash = Encoding::hash(key);
+
+        for (size_t section = 0; section < Fundamentals::sectionCount; section++) {
+            if (!Bitfield<Sections>(job.sections).get(section)) continue;
+
+            if (!write(hash, key, section, Encoding::encode(*job.blob, section)))
+                { warn(engine); exec(engine, rollback); return false; }
+        }
+    }
+
+    if (!exec(engine, commit)) { exec(engine, rollback); return false; }
+
+    return true;
+}
+
+const int backupPages = 64; // per step
+
+bool SQLiteStore::backup(const std::string & filename) {
+    if (busy()) return false;
+
+    target = filename; return resume();
+}
+
+/*
+    Backup uses the writer’s own connection, so it’s never restarted by saves (they are copied as well)
+    and never sees a half-written batch, since steps are done only between flushes.
+*/
+bool SQLiteStore::step() {
+    if (progress == nullptr) {
+        auto part = target + ".part"; std::remove(part.c_str());
+
+        if (sqlite3_open(part.c_str(), &copy) == SQLITE_OK)
+            progress = sqlite3_backup_init(copy, "main", engine, "main");
+
+        if (progress == nullptr) { warn(copy); finish(false); return false; }
+    }
+
+    auto retval = sqlite3_backup_step(progress, backupPages);
+    if (retval == SQLITE_OK || retval == SQLITE_BUSY || retval == SQLITE_LOCKED) return true;
+
+    if (retval != SQLITE_DONE) warn(copy);
+    finish(retval == SQLITE_DONE); return false;
+}
+
+// Completes (or abandons) the backup, if any.
+void SQLiteStore::finish(bool done) {
+    if (copy == nullptr) return;
+
+    if (progress != nullptr) sqlite3_backup_finish(progress);
+    sqlite3_close(copy); progress = nullptr; copy = nullptr;
+
+    auto part = target + ".part";
+
+    if (done && std::rename(part.c_str(), target.c_str()) == 0)
+        std::fprintf(stderr, "Backup saved to “%s”\n", target.c_str());
+    else { std::remove(part.c_str()); std::fprintf(stderr, "Backup to “%s” failed\n", target.c_str()); }
+}
+
+ChunkStore::Report SQLiteStore::maintain() {
+    Report report; report.before = size(engine);
+
+    sqlite3_stmt * keys = nullptr, * select = nullptr, * erase = nullptr;
+
+    auto retval = sqlite3_prepare_v2(engine, keyscmd, -1, &keys, nullptr);
+    if (retval == SQLITE_OK) retval = sqlite3_prepare_v2(engine, sectionscmd, -1, &select, nullptr);
+    if (retval == SQLITE_OK) retval = sqlite3_prepare_v2(engine, deletecmd, -1, &erase, nullptr);
+
+    // Table is modified below, so keys are collected beforehand.
+    std::vector<std::pair<int64_t, std::string>> chunks;
+
+    while (retval == SQLITE_OK && (retval = sqlite3_step(keys)) == SQLITE_ROW) {
+        auto data = static_cast<const char *>(sqlite3_column_blob(keys, 1));
+        chunks.emplace_back(sqlite3_column_int64(keys, 0), std::string(data, sqlite3_column_bytes(keys, 1)));
+        retval = SQLITE_OK;
+    }
+
+    if (retval == SQLITE_DONE) retval = sqlite3_exec(engine, "BEGIN;", nullptr, 0, nullptr);
+
+    auto bind = [](sqlite3_stmt * statement, int64_t hash, const std::string & key) {
+        sqlite3_bind_int64(statement, 1, hash);
+        sqlite3_bind_blob(statement, 2, key.data(), key.size(), SQLITE_STATIC);
+    };
+
+    for (auto & [hash, key] : chunks) {
+        if (retval != SQLITE_OK) break;
+
+        std::vector<uint8_t> copies[Fundamentals::sectionCount]; Stored stored; Sections present = 0, local = 0;
+
+        bind(select, hash, key);
+
+        while (sqlite3_step(select) == SQLITE_ROW) {
+            auto section = sqlite3_column_int(select, 0);
+            if (section < 0 || section >= Fundamentals::sectionCount) continue;
+
+            auto data = static_cast<const uint8_t *>(sqlite3_column_blob(select, 1));
+            copies[section].assign(data, data + sqlite3_column_bytes(select, 1));
+
+            stored[section] = {copies[section].data(), copies[section].size()};
+            present |= Sections(1) << section;
+
+            if (sqlite3_column_int(select, 2) && copies[section].size() >= sharedPayload)
+                local |= Sections(1) << section;
+        }
+
+        sqlite3_reset(select); sqlite3_clear_bindings(select);
+
+        auto verdict = examine(stored, present, report);
+
+        // Big sections stored inline (e.g. migrated) are moved to shared payloads.
+        for (size_t section = 0; section < Fundamentals::sectionCount; section++) {
+            if (!Bitfield<Sections>(local & ~verdict.erase & ~verdict.rewrite).get(section)) continue;
+
+            verdict.rewrite |= Sections(1) << section;
+            verdict.data[section] = copies[section];
+        }
+
+        for (size_t section = 0; section < Fundamentals::sectionCount && retval == SQLITE_OK; section++) {
+            if (Bitfield<Sections>(verdict.erase).get(section)) {
+                bind(erase, hash, key); sqlite3_bind_int(erase, 3, section);
+                if (sqlite3_step(erase) != SQLITE_DONE) retval = SQLITE_ERROR;
+                sqlite3_reset(erase);
+            }
+
+            if (Bitfield<Sections>(verdict.rewrite).get(section) && !write(hash, key, section, verdict.data[section]))
+                retval = SQLITE_ERROR;
+        }
+    }
+
+    for (auto statement : {keys, select, erase}) sqlite3_finalize(statement);
+
+    if (retval == SQLITE_OK) retval = sqlite3_exec(engine, orphanscmd, nullptr, 0, nullptr);
+    if (retval == SQLITE_OK) retval = sqlite3_exec(engine, "COMMIT;", nullptr, 0, nullptr);
+
+    if (retval != SQLITE_OK) {
+        warn(engine); sqlite3_exec(engine, "ROLLBACK;", nullptr, 0, nullptr);
+        throw std::runtime_error("world maintenance failed");
+    }
+
+    if (sqlite3_exec(engine, "VACUUM; PRAGMA wal_checkpoint(TRUNCATE);", nullptr, 0, nullptr) != SQLITE_OK) warn(engine);
+
+    report.after = size(engine);
+
+    return report;
+}
+
+void Readers::open(const std::string & filename, size_t count) {
+    for (size_t i = 0; i < count; i++) {
+        Connection conn{nullptr, nullptr};
+
+        auto retval = sqlite3_open_v2(filename.c_str(), &conn.engine, SQLITE_OPEN_READONLY | SQLITE_OPEN_NOMUTEX, nullptr);
+
+        if (retval == SQLITE_OK)
+            retval = sqlite3_prepare_v3(conn.engine, loadcmd, -1, SQLITE_PREPARE_PERSISTENT, &conn.statement, nullptr);
+
+        if (retval != SQLITE_OK) {
+            warn(conn.engine); sqlite3_close(conn.engine); close();
+            throw std::runtime_error("unable to open read connection");
+        }
+
+        sqlite3_busy_timeout(conn.engine, busyTimeout);
+        all.push_back(conn); idle.push_back(conn);
+    }
+}
+
+void Readers::close() {
+    std::unique_lock<std::mutex> lock(mutex);
+    cv.wait(lock, [this]() { return idle.size() == all.size(); });
+
+    for (auto & conn : all) {
+        sqlite3_finalize(conn.statement);
+        sqlite3_close(conn.engine);
+    }
+
+    all.clear(); idle.clear();
+}
+
+Readers::Connection Readers::acquire() {
+    std::unique_lock<std::mutex> lock(mutex);
+    cv.wait(lock, [this]() { return !idle.empty(); });
+
+    auto retval = idle.back(); idle.pop_back(); return retval;
+}
+
+void Readers::release(const Connection & conn) {
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        idle.push_back(conn);
+    }
+
+    cv.notify_all();
+}
+
+#ifndef _WIN32
+
+constexpr char regionMagic[8] = {'H', 'Y', 'P', 'E', 'R', 'R', 'G', '1'};
+
+constexpr size_t pageSize = 4096, initialCapacity = 4096, granularity = 1 << 20;
+
+constexpr inline size_t align(size_t n, size_t k) { return (n + k - 1) / k * k; }
+
+RegionStore::RegionStore(const std::string & filename) : filename(filename) {
+    fd = ::open(filename.c_str(), O_RDWR | O_CREAT, 0644);
+    if (fd < 0) throw std::runtime_error("unable to open “" + filename + "”: " + std::strerror(errno));
+
+    struct stat st; fstat(fd, &st); size_t size = st.st_size;
+
+    if (size == 0) {
+        size = pageSize + initialCapacity * sizeof(Slot);
+
+        if (ftruncate(fd, size) != 0) { ::close(fd); throw std::runtime_error("`ftruncate` failed"); }
+        remap(size);
+
+        memcpy(header()->magic, regionMagic, sizeof(regionMagic));
+        header()->indexOffset = pageSize;
+        header()->capacity    = initialCapacity;
+        header()->count       = 0;
+        header()->end         = size;
+
+        sync(0, size);
+    } else {
+        if (size < sizeof(Header)) { ::close(fd); throw std::runtime_error("“" + filename + "” is not a region file"); }
+        remap(size);
+
+        if (memcmp(header()->magic, regionMagic, sizeof(regionMagic)) != 0 || size < header()->end) {
+            munmap(map, mapped); ::close(fd);
+            throw std::runtime_error("“" + filename + "” is not a region file");
+        }
+    }
+
+    start();
+}
+
+RegionStore::~RegionStore() {
+    stop(); finish(false);
+
+    munmap(map, mapped);
+    ::close(fd);
+}
+
+void RegionStore::remap(size_t size) {
+    if (map != nullptr) munmap(map, mapped);
+
+    auto retval = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    if (retval == MAP_FAILED) throw std::runtime_error("`mmap` failed");
+
+    map = static_cast<uint8_t *>(retval); mapped = size;
+}
+
+// Requires exclusive lock.
+void RegionStore::reserve(size_t size) {
+    if (size <= mapped) return;
+
+    auto n = align(std::max(size, mapped + mapped / 2), granularity);
+    if (ftruncate(fd, n) != 0) throw std::runtime_error("`ftruncate` failed");
+
+    remap(n);
+}
+
+void RegionStore::sync(size_t from, size_t to)
+{ auto start = from / pageSize * pageSize; msync(map + start, to - start, MS_SYNC); }
+
+// Returns either the slot of the given key or the empty slot where it should be placed.
+RegionStore::Slot * RegionStore::find(int64_t hash, const std::string & key) const {
+    auto mask = header()->capacity - 1;
+
+    for (auto i = uint64_t(hash) & mask; ; i = (i + 1) & mask) {
+        auto slot = slots() + i;
+
+        if (slot->offset == 0) return slot;
+
+        if (slot->hash == hash) {
+            Record record; memcpy(&record, map + slot->offset, sizeof(Record));
+
+            if (record.keySize == key.size() && memcmp(map + slot->offset + sizeof(Record), key.data(), key.size()) == 0)
+                return slot;
+        }
+    }
+}
+
+void RegionStore::insert(int64_t hash, uint64_t offset) {
+    auto mask = header()->capacity - 1, i = uint64_t(hash) & mask;
+    while (slots()[i].offset != 0) i = (i + 1) & mask;
+
+    slots()[i] = {hash, offset};
+}
+
+// Appends the bigger table, old one is left as garbage. Space must be already reserved.
+void RegionStore::grow(uint64_t capacity) {
+    auto H = header(); auto oldIndex = slots(); auto oldCapacity = H->capacity;
+
+    auto offset = align(H->end, alignof(Slot));
+    memset(map + offset, 0, capacity * sizeof(Slot));
+
+    H->indexOffset = offset; H->capacity = capacity;
+    H->end = offset + capacity * sizeof(Slot);
+
+    for (size_t i = 0; i < oldCapacity; i++)
+        if (oldIndex[i].offset != 0)
+            insert(oldIndex[i].hash, oldIndex[i].offset);
+}
+
+// Returns the data of the record at the given offset, following the reference if needed.
+const uint8_t * RegionStore::data(uint64_t offset, uint32_t & size) const {
+    Record record; memcpy(&record, map + offset, sizeof(Record));
+
+    if (record.dataSize & Record::shared) {
+        memcpy(&offset, map + offset + sizeof(Record) + record.keySize, sizeof(uint64_t));
+        memcpy(&record, map + offset, sizeof(Record));
+    }
+
+    size = record.dataSize; return map + offset + sizeof(Record) + record.keySize;
+}
+
+// Returns the data of the latest record with the given key (or nullptr), requires shared lock.
+const uint8_t * RegionStore::lookup(const std::string & key, uint32_t & size) const {
+    auto slot = find(Encoding::hash(key), key);
+    return slot->offset == 0 ? nullptr : data(slot->offset, size);
+}
+
+bool RegionStore::read(const Gaussian²<Integer> & pos, Blob & blob, Sections & stale) {
+    auto key = Encoding::key(pos); bool found = false;
+
+    std::shared_lock<std::shared_mutex> guard(lock);
+
+    for (size_t section = 0; section < Fundamentals::sectionCount; section++) {
+        uint32_t size; auto data = lookup(key + char(section), size);
+        if (data != nullptr) { decode(blob, section, data, size); found = true; }
+    }
+
+    if (found) return true;
+
+    // Chunk stored as a whole is rewritten section by section on the next save.
+    uint32_t size; auto data = lookup(key, size);
+    if (data == nullptr) return false;
+
+    decode(blob, data, size); stale |= Fundamentals::allSections;
+
+    return true;
+}
+
+bool RegionStore::flush(std::vector<Job> & jobs) {
+    std::vector<Entry> entries; entries.reserve(jobs.size());
+
+    for (auto & job : jobs) {
+        auto chunk = Encoding::key(job.pos);
+
+        for (size_t section = 0; section < Fundamentals::sectionCount; section++) {
+            if (!Bitfield<Sections>(job.sections).get(section)) continue;
+
+            auto key = chunk + char(section); auto hash = Encoding::hash(key);
+            entries.push_back({std::move(key), hash, Encoding::encode(*job.blob, section), 0});
+        }
+    }
+
+    return append(entries);
+}
+
+// Writes the records and makes the index refer to them; called only from the writer thread (or offline).
+bool RegionStore::append(std::vector<Entry> & entries) {
+    size_t total = 0;
+
+    for (auto & entry : entries)
+        total += align(sizeof(Record) + entry.key.size() + entry.data.size(), alignof(Record));
+
+    // Only the writer thread modifies the header, so it’s safe to read it without lock here.
+    auto capacity = header()->capacity;
+    while (2 * (header()->count + entries.size()) > capacity) capacity *= 2;
+
+    auto indexSize = capacity != header()->capacity ? capacity * sizeof(Slot) + alignof(Slot) : 0;
+
+    try {
+        std::unique_lock<std::shared_mutex> guard(lock);
+        reserve(header()->end + total + indexSize);
+    } catch (const std::runtime_error & err) {
+        std::fprintf(stderr, "Region file: %s\n", err.what());
+        return false;
+    }
+
+    // Readers never look past `header()->end`, so records are written without lock.
+    auto start = header()->end, offset = start;
+
+    for (auto & entry : entries) {
+        Record record{uint32_t(entry.key.size()), uint32_t(entry.data.size())};
+        const void * data = entry.data.data(); size_t size = entry.data.size(); uint64_t source = 0;
+
+        if (size >= sharedPayload) {
+            auto digest = Encoding::hash(data, size); auto it = payloads.find(digest);
+
+            if (it != payloads.end()) {
+                uint32_t n; auto other = RegionStore::data(it->second, n);
+
+                if (n == size && memcmp(other, data, size) == 0) {
+                    source = it->second; record.dataSize = Record::shared | sizeof(uint64_t);
+                    data = &source; size = sizeof(uint64_t);
+                }
+            } else payloads[digest] = offset;
+        }
+
+        memcpy(map + offset, &record, sizeof(Record));
+        memcpy(map + offset + sizeof(Record), entry.key.data(), entry.key.size());
+        memcpy(map + offset + sizeof(Record) + entry.key.size(), data, size);
+
+        entry.offset = offset; offset += align(sizeof(Record) + entry.key.size() + size, alignof(Record));
+    }
+
+    // Records must reach the disk before the index refers to them.
+    sync(start, offset);
+
+    {
+        std::unique_lock<std::shared_mutex> guard(lock);
+
+        header()->end = offset;
+        if (capacity != header()->capacity) grow(capacity);
+
+        for (auto & entry : entries) {
+            auto slot = find(entry.hash, entry.key);
+            if (slot->offset == 0) header()->count++;
+
+            *slot = {entry.hash, entry.offset};
+        }
+    }
+
+    sync(header()->indexOffset, header()->indexOffset + header()->capacity * sizeof(Slot));
+    sync(0, sizeof(Header));
+
+    return true;
+}
+
+// Size of the chunk key at the beginning of the given one or 0 if it’s malformed, see `Encoding::key`.
+size_t chunkKeySize(const std::string & key) {
+    size_t i = 0;
+
+    for (size_t n = 0; n < 4; n++) {
+        size_t m = 0;
+
+        for (size_t shift = 0; ; shift += 7) {
+            if (i >= key.size() || shift > 56) return 0;
+
+            auto byte = uint8_t(key[i++]); m |= size_t(byte & 0x7F) << shift;
+            if (!(byte & 0x80)) break;
+        }
+
+        i += m / 2; if (i > key.size()) return 0;
+    }
+
+    return i;
+}
+
+// Region is compacted by writing the latest records into a new file, which then replaces the old one.
+ChunkStore::Report RegionStore::maintain() {
+    struct Group { std::pair<const uint8_t *, size_t> whole{nullptr, 0}; Stored stored; Sections present = 0; };
+
+    Report report; report.before = mapped;
+
+    std::unordered_map<std::string, Group> chunks; std::vector<Entry> entries;
+
+    for (size_t i = 0; i < header()->capacity; i++) {
+        auto slot = slots()[i]; if (slot.offset == 0) continue;
+
+        Record record; memcpy(&record, map + slot.offset, sizeof(Record));
+        std::string key(reinterpret_cast<const char *>(map + slot.offset + sizeof(Record)), record.keySize);
+
+        uint32_t size; auto data = RegionStore::data(slot.offset, size); auto n = chunkKeySize(key);
+
+        if (n != 0 && n == key.size())
+            chunks[key].whole = {data, size};
+        else if (n != 0 && n + 1 == key.size() && uint8_t(key.back()) < Fundamentals::sectionCount) {
+            auto & chunk = chunks[key.substr(0, n)]; size_t section = uint8_t(key.back());
+            chunk.stored[section] = {data, size}; chunk.present |= Sections(1) << section;
+        } else {
+            report.corrupt++;
+            entries.push_back({key, slot.hash, std::vector<uint8_t>(data, data + size), 0});
+        }
+    }
+
+    auto blob = new Blob();
+
+    for (auto & [key, chunk] : chunks) {
+        std::vector<uint8_t> legacy[Fundamentals::sectionCount]; bool converted = chunk.present == 0;
+
+        // Whole-chunk record is used only if there are no sections, just like in `load`.
+        if (converted) {
+            auto [data, size] = chunk.whole;
+
+            if (!Encoding::decode(*blob, data, size)) {
+                report.chunks++; report.corrupt++;
+                entries.push_back({key, Encoding::hash(key), std::vector<uint8_t>(data, data + size), 0});
+                continue;
+            }
+
+            for (size_t section = 0; section < Fundamentals::sectionCount; section++) {
+                legacy[section] = Encoding::encode(*blob, section);
+                chunk.stored[section] = {legacy[section].data(), legacy[section].size()};
+            }
+
+            chunk.present = Fundamentals::allSections;
+        }
+
+        auto verdict = examine(chunk.stored, chunk.present, report);
+
+        for (size_t section = 0; section < Fundamentals::sectionCount; section++) {
+            if (!Bitfield<Sections>(chunk.present & ~verdict.erase).get(section)) continue;
+
+            auto [data, size] = chunk.stored[section]; auto bytes = static_cast<const uint8_t *>(data);
+            if (converted) report.reencoded++;
+
+            auto sectionKey = key + char(section);
+            entries.push_back({sectionKey, Encoding::hash(sectionKey), Bitfield<Sections>(verdict.rewrite).get(section) ?
+                               std::move(verdict.data[section]) : std::vector<uint8_t>(bytes, bytes + size), 0});
+        }
+    }
+
+    delete blob;
+
+    auto temporary = filename + ".tmp"; std::remove(temporary.c_str()); size_t end;
+
+    {
+        RegionStore fresh(temporary);
+        if (!fresh.append(entries)) throw std::runtime_error("unable to write “" + temporary + "”");
+        end = fresh.header()->end;
+    }
+
+    if (truncate(temporary.c_str(), end) != 0 || std::rename(temporary.c_str(), filename.c_str()) != 0)
+        throw std::runtime_error("unable to replace “" + filename + "”: " + std::strerror(errno));
+
+    std::unique_lock<std::shared_mutex> guard(lock);
+
+    munmap(map, mapped); map = nullptr; ::close(fd);
+
+    fd = ::open(filename.c_str(), O_RDWR);
+    if (fd < 0) throw std::runtime_error("unable to open “" + filename + "”: " + std::strerror(errno));
+
+    remap(end); payloads.clear(); report.after = end;
+
+    return report;
+}
+
+constexpr size_t backupBytes = 1 << 20; // per step
+
+bool RegionStore::backup(const std::string & filename) {
+    if (busy()) return false;
+
+    target = filename; return resume();
+}
+
+/*
+    Records are never modified once written, so everything before `snapshot.end` except header
+    and the index can be copied gradually; both of them are copied as they were when the backup started.
+*/
+bool RegionStore::step() {
+    if (copy < 0) {
+        auto part = target + ".part";
+
+        copy = ::open(part.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+        if (copy < 0) { std::fprintf(stderr, "Backup to “%s” failed: %s\n", target.c_str(), std::strerror(errno)); return false; }
+
+        memcpy(&snapshot, header(), sizeof(Header)); copied = 0;
+        index.assign(slots(), slots() + snapshot.capacity);
+    }
+
+    auto size = std::min<uint64_t>(backupBytes, snapshot.end - copied);
+
+    if (size > 0) {
+        if (pwrite(copy, map + copied, size, copied) != ssize_t(size)) { finish(false); return false; }
+        copied += size; return true;
+    }
+
+    bool done = pwrite(copy, index.data(), index.size() * sizeof(Slot), snapshot.indexOffset) == ssize_t(index.size() * sizeof(Slot))
+             && pwrite(copy, &snapshot, sizeof(Header), 0) == ssize_t(sizeof(Header)) && fsync(copy) == 0;
+
+    finish(done); return false;
+}
+
+// Completes (or abandons) the backup, if any.
+void RegionStore::finish(bool done) {
+    if (copy < 0) return;
+
+    ::close(copy); copy = -1; index.clear();
+
+    auto part = target + ".part";
+
+    if (done && std::rename(part.c_str(), target.c_str()) == 0)
+        std::fprintf(stderr, "Backup saved to “%s”\n", target.c_str());
+    else { std::remove(part.c_str()); std::fprintf(stderr, "Backup to “%s” failed\n", target.c_str()); }
+}
+
+#endif
@@ -0,0 +1,32 @@
+#include <cstdio>
+
+#include <Hyper/Storage.hxx>
+
+/*
+    Offline world maintenance, doesn’t need GL or Lua:
+        hyper-worldtool <world> [sqlite|region]
+*/
+int main(int argc, char * argv[]) {
+    if (argc < 2 || argc > 3) {
+        std::fprintf(stderr, "Usage: %s <world> [sqlite|region]\n", argv[0]);
+        return 1;
+    }
+
+    std::string kind = argc > 2 ? argv[2] : "sqlite";
+
+    try {
+        auto store = ChunkStore::open(kind, argv[1]);
+        auto report = store->maintain();
+        delete store;
+
+        std::printf("Chunks:    %zu (%zu dropped as air)\n", report.chunks, report.dropped);
+        std::printf("Sections:  %zu (%zu re-encoded, %zu of air removed, %zu corrupt)\n",
+                    report.sections, report.reencoded, report.cleared, report.corrupt);
+        std::printf("Size:      %zu → %zu bytes\n", report.before, report.after);
+
+        return report.corrupt > 0 ? 2 : 0;
+    } catch (const std::exception & err) {
+        std::fprintf(stderr, "%s\n", err.what());
+        return 1;
+    }
+}
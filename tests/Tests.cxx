@@ -0,0 +1,39 @@
+#include <cstdio>
+
+#include <Hyper/Geometry.hxx>
+
+static int failures = 0;
+
+#define check(cond) do { if (!(cond)) { std::fprintf(stderr, "%s:%d: check failed: %s\n", __FILE__, __LINE__, #cond); failures++; } } while (0)
+
+// Section that becomes all air again is represented by null pointer, as if it was never written.
+void sectionsOfAir() {
+    using namespace Fundamentals;
+
+    Chunk chunk(Tesselation::I, Tesselation::I); chunk.generate(nullptr);
+    auto s = 40 / sectionHeight;
+
+    chunk.set(3, 40, 5, {1});
+    check(!chunk.blob()->empty(s)); check(chunk.summary().occupancy(s) == 1);
+
+    chunk.set(3, 40, 5, {0});
+    check(chunk.blob()->empty(s)); check(chunk.summary().occupancy(s) == 0);
+
+    // Section stays as long as it holds at least one node.
+    chunk.set(3, 40, 5, {1}); chunk.set(4, 41, 5, {2}); chunk.set(3, 40, 5, {0});
+    check(!chunk.blob()->empty(s));
+
+    chunk.set(4, 41, 5, {0});
+    check(chunk.blob()->empty(s));
+
+    // The same goes for blobs modified directly.
+    chunk.blob()->set(0, 0, 0, {1}); chunk.blob()->set(0, 0, 0, {0}); chunk.markDirty();
+    check(chunk.blob()->empty(0));
+}
+
+int main() {
+    sectionsOfAir();
+
+    if (failures == 0) std::printf("All checks passed\n");
+    return failures == 0 ? 0 : 1;
+}